@@ -0,0 +1,126 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <hist.h>
+
+static inline uint64_t bench_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t bench_cpu_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// raises the file descriptor limit as far as allowed; returns the new soft limit
+static inline size_t bench_nofile(size_t want)
+{
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) return 0;
+
+    if (rl.rlim_cur < want)
+    {
+        rl.rlim_cur = (want < rl.rlim_max) ? want : rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    return (size_t) rl.rlim_cur;
+}
+
+// results also go as JSON lines to the file named by BENCH_OUT, if any, so runs can be compared
+static inline FILE* bench_out()
+{
+    static FILE*    out;
+    static int      opened;
+
+    if (!opened)
+    {
+        const char* path = getenv("BENCH_OUT");
+
+        opened  = 1;
+        out     = (path && *path) ? fopen(path, "a") : NULL;
+    }
+
+    return out;
+}
+
+// percentiles are in ns; lat may be NULL for benchmarks that only measure throughput
+static inline void bench_record(const char* name, size_t count, uint64_t ns, const hist_t* lat)
+{
+    FILE*   out = bench_out();
+    hist_t  snap;
+
+    if (out == NULL) return;
+
+    fprintf(out, "{\"name\": \"%s\", \"ops\": %zu, \"ns\": %llu, \"ns_per_op\": %.1f, \"ops_per_s\": %.0f",
+        name, count, (unsigned long long) ns, count ? (double) ns / count : 0.0,
+        ns ? (double) count * 1e9 / ns : 0.0);
+
+    if (lat)
+    {
+        hist_get(lat, &snap);
+        fprintf(out, ", \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu",
+            (unsigned long long) hist_pct(&snap, 50.0), (unsigned long long) hist_pct(&snap, 90.0),
+            (unsigned long long) hist_pct(&snap, 99.0), (unsigned long long) hist_pct(&snap, 99.9),
+            (unsigned long long) snap.max);
+    }
+
+    fprintf(out, "}\n");
+    fflush(out);
+}
+
+static inline void bench_report(const char* name, size_t count, uint64_t ns)
+{
+    printf("%-32s %10zu ops %12.1f ns/op %14.0f ops/s\n",
+        name, count, count ? (double) ns / count : 0.0,
+        ns ? (double) count * 1e9 / ns : 0.0);
+
+    bench_record(name, count, ns, NULL);
+}
+
+// bench_report with latency percentiles of the individual operations
+static inline void bench_report_lat(const char* name, size_t count, uint64_t ns, const hist_t* lat)
+{
+    hist_t  snap;
+
+    hist_get(lat, &snap);
+
+    printf("%-32s %10zu ops %12.1f ns/op %14.0f ops/s  p50 %llu p99 %llu p99.9 %llu max %llu ns\n",
+        name, count, count ? (double) ns / count : 0.0,
+        ns ? (double) count * 1e9 / ns : 0.0,
+        (unsigned long long) hist_pct(&snap, 50.0), (unsigned long long) hist_pct(&snap, 99.0),
+        (unsigned long long) hist_pct(&snap, 99.9), (unsigned long long) snap.max);
+
+    bench_record(name, count, ns, lat);
+}
+
+#endif // __BENCH_H__
@@ -0,0 +1,153 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+// accepts and registrations per second with the per-context slab and with the heap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <mevel.h>
+
+#include "bench.h"
+
+#define CHURN_PATH  "/tmp/mevel_bench_churn.sock"
+
+static size_t           closed;
+static size_t           total;
+
+static mevel_err_t on_conn(mevel_event_t* ev, int flags)
+{
+    char buf[64];
+
+    if (read(ev->fd, buf, sizeof(buf)) > 0) return MEVEL_ERR_NONE;
+
+    // the peer hung up; returning an error makes the loop close and release it
+    if (++closed == total) __atomic_store_n(&ev->ctx->running, 0x00, __ATOMIC_RELEASE);
+
+    return MEVEL_ERR_CLOSE;
+}
+
+static void* client(void* arg)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0x00, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, CHURN_PATH, sizeof(addr.sun_path) - 1);
+
+    for (size_t i = 0; i < total; i++)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        while (connect(fd, (struct sockaddr*) &addr, sizeof(struct sockaddr_un)) < 0)
+        {
+            // the accept queue is full; give the loop a moment
+            usleep(10);
+        }
+
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static void bench_accept(const char* name, int flags, size_t prealloc, size_t count)
+{
+    mevel_cfg_t     cfg;
+    pthread_t       thread;
+
+    memset(&cfg, 0x00, sizeof(mevel_cfg_t));
+    cfg.flags       = flags;
+    cfg.prealloc    = prealloc;
+
+    mevel_ctx_t* ctx = mevel_ini_cfg(&cfg);
+
+    unlink(CHURN_PATH);
+
+    if (ctx == NULL || mevel_add_tcp(ctx, on_conn, MEVEL_UNIX, CHURN_PATH, 0, MEVEL_READ) != MEVEL_ERR_NONE)
+    {
+        fprintf(stderr, "%s: can not listen on %s\n", name, CHURN_PATH);
+        mevel_rel(ctx);
+        return;
+    }
+
+    closed  = 0;
+    total   = count;
+
+    uint64_t t0 = bench_ns();
+    pthread_create(&thread, NULL, client, NULL);
+    mevel_run(ctx);
+    pthread_join(thread, NULL);
+    bench_report(name, count, bench_ns() - t0);
+
+    mevel_rel(ctx);
+    unlink(CHURN_PATH);
+}
+
+static mevel_err_t on_timer(mevel_event_t* ev, int exp)
+{
+    return MEVEL_ERR_NONE;
+}
+
+// registration without system calls isolates the allocator
+static void bench_register(const char* name, int flags, size_t prealloc, size_t count)
+{
+    mevel_cfg_t     cfg;
+    mevel_event_t*  evs[64];
+
+    memset(&cfg, 0x00, sizeof(mevel_cfg_t));
+    cfg.flags       = flags;
+    cfg.prealloc    = prealloc;
+
+    mevel_ctx_t* ctx = mevel_ini_cfg(&cfg);
+
+    if (ctx == NULL) return;
+
+    uint64_t t0 = bench_ns();
+    for (size_t i = 0; i < count; i += 64)
+    {
+        for (int n = 0; n < 64; n++)
+        {
+            evs[n] = mevel_ini_timer(ctx, on_timer, 1000 + n, 0);
+            mevel_add(ctx, evs[n]);
+        }
+
+        for (int n = 0; n < 64; n++) mevel_del(ctx, evs[n]);
+    }
+    bench_report(name, count, bench_ns() - t0);
+
+    mevel_rel(ctx);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = (argc > 1) ? (size_t) atoll(argv[1]) : 50000;
+
+    bench_accept("accept churn heap", MEVEL_CTX_NOSLAB, 0, count);
+    bench_accept("accept churn slab", 0, 0, count);
+    bench_accept("accept churn slab prealloc", 0, 1024, count);
+
+    bench_register("register churn heap", MEVEL_CTX_NOSLAB, 0, count * 20);
+    bench_register("register churn slab", 0, 0, count * 20);
+    bench_register("register churn slab prealloc", 0, 1024, count * 20);
+
+    return 0;
+}
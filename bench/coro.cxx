@@ -0,0 +1,192 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+// coroutines against callbacks on the C++ loop: ping-pong over unix socket pairs
+// with every side waiting for readiness, the cost of a zero sleep, and the cost
+// of a coroutine frame from the pool of a coro and from the heap
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <coro.h>
+
+#include "bench.h"
+
+#define MSG_SIZE    64
+
+static size_t           exchanged;
+static size_t           total;
+
+static void bench_callback(size_t pairs, size_t count)
+{
+    mevel::mevel        loop(1024, 1024);
+    std::vector<int>    fds;
+
+    exchanged   = 0;
+    total       = count;
+
+    for (size_t i = 0; i < pairs; i++)
+    {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv);
+        fds.push_back(sv[0]);
+        fds.push_back(sv[1]);
+
+        // both sides send back what they get; one side counts the round trips
+        for (int side = 0; side < 2; side++)
+        {
+            loop.add_fio([&loop, side](const mevel::mevent& ev, int flags)
+            {
+                char    buf[MSG_SIZE];
+                ssize_t len = ::read(ev.fd, buf, sizeof(buf));
+
+                if (len <= 0) return mevel::MEVEL_ERR_NONE;
+                if (side == 0 && ++exchanged >= total) loop.stop();
+                if (::write(ev.fd, buf, len) != len) return mevel::MEVEL_ERR_CLOSE;
+
+                return mevel::MEVEL_ERR_NONE;
+            }, sv[side], MEVEL_READ);
+        }
+
+        char buf[MSG_SIZE] = {};
+        if (::write(sv[0], buf, sizeof(buf)) < 0) perror("write");
+    }
+
+    uint64_t t0 = bench_ns();
+    loop.run();
+    bench_report("callback ping-pong", exchanged, bench_ns() - t0);
+
+    for (int fd : fds) close(fd);
+}
+
+static mevel::task<> pong(mevel::coro& io, int fd, bool counting)
+{
+    char buf[MSG_SIZE];
+
+    for (;;)
+    {
+        ssize_t len = co_await io.read(fd, buf, sizeof(buf));
+
+        if (len <= 0) break;
+        if (counting && ++exchanged >= total) io.get_loop().stop();
+        if (co_await io.write(fd, buf, len) != len) break;
+    }
+}
+
+static void bench_coro(size_t pairs, size_t count)
+{
+    mevel::mevel        loop(1024, 1024);
+    std::vector<int>    fds;
+
+    exchanged   = 0;
+    total       = count;
+
+    {
+        mevel::coro     io(loop);
+
+        for (size_t i = 0; i < pairs; i++)
+        {
+            int sv[2];
+            socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv);
+            fds.push_back(sv[0]);
+            fds.push_back(sv[1]);
+
+            io.spawn(pong(io, sv[0], true));
+            io.spawn(pong(io, sv[1], false));
+
+            char buf[MSG_SIZE] = {};
+            if (::write(sv[0], buf, sizeof(buf)) < 0) perror("write");
+        }
+
+        uint64_t t0 = bench_ns();
+        loop.run();
+        bench_report("coroutine ping-pong", exchanged, bench_ns() - t0);
+    }
+
+    for (int fd : fds) close(fd);
+}
+
+static mevel::task<> yielder(mevel::coro& io, size_t count)
+{
+    for (exchanged = 0; exchanged < count; exchanged++) co_await io.sleep_for(0);
+
+    io.get_loop().stop();
+}
+
+// every zero sleep suspends until the deferred tasks of the iteration run
+static void bench_yield(size_t count)
+{
+    mevel::mevel        loop;
+    mevel::coro         io(loop);
+
+    io.spawn(yielder(io, count));
+
+    uint64_t t0 = bench_ns();
+    loop.run();
+    bench_report("coroutine yield", exchanged, bench_ns() - t0);
+
+    if (exchanged != count) printf("yield benchmark stopped early\n");
+}
+
+static mevel::task<size_t> leaf(size_t indx)
+{
+    co_return indx;
+}
+
+static mevel::task<> caller(size_t count, size_t* sum)
+{
+    for (size_t indx = 0; indx < count; indx++) *sum += co_await leaf(indx);
+}
+
+// every awaited leaf allocates and frees one frame; nothing suspends
+static void bench_frames(const char* name, size_t count)
+{
+    size_t  sum = 0;
+
+    uint64_t t0 = bench_ns();
+    mevel::task<>::handle_t handle = caller(count, &sum).release();
+    handle.resume();
+    handle.destroy();
+    bench_report(name, count, bench_ns() - t0);
+
+    if (sum != count * (count - 1) / 2) printf("frame benchmark miscounted\n");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t pairs    = (argc > 1) ? (size_t) atoll(argv[1]) : 100;
+    size_t count    = (argc > 2) ? (size_t) atoll(argv[2]) : 1000000;
+
+    bench_nofile(2 * pairs + 64);
+
+    bench_callback(pairs, count);
+    bench_coro(pairs, count);
+    bench_yield(count);
+
+    bench_frames("coroutine frame (heap)", 10 * count);
+
+    {
+        mevel::mevel    loop;
+        mevel::coro     io(loop);
+
+        bench_frames("coroutine frame (pool)", 10 * count);
+    }
+
+    return 0;
+}
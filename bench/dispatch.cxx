@@ -0,0 +1,202 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+// cost per dispatched event of the C++ loop and of the C loop; every eventfd
+// stays readable, so each wait returns a full batch of level-triggered events.
+// The group delete run also checks that an event deleted while it waits for its
+// group handler is left out of the handler's items
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <mevel.h>
+
+#include "bench.h"
+
+static size_t           dispatched;
+static size_t           total;
+
+// the C++ loop takes the MEVEL_CTX_METRICS and MEVEL_CTX_TRACE flags through its enable_* calls
+static void bench_cxx(const char* name, size_t fds, size_t count, int flags)
+{
+    mevel::mevel        loop(1024, 1024);
+    std::vector<int>    evfds;
+
+    if (flags & MEVEL_CTX_METRICS) loop.enable_metrics();
+    if (flags & MEVEL_CTX_TRACE) loop.enable_trace();
+
+    dispatched  = 0;
+    total       = count;
+
+    for (size_t i = 0; i < fds; i++)
+    {
+        int fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        evfds.push_back(fd);
+
+        loop.add_fio([&loop](const mevel::mevent& ev, int flags)
+        {
+            if (++dispatched == total) loop.stop();
+            return mevel::MEVEL_ERR_NONE;
+        }, fd, MEVEL_READ);
+    }
+
+    uint64_t t0 = bench_ns();
+    loop.run();
+    bench_report(name, dispatched, bench_ns() - t0);
+
+    for (int fd : evfds) close(fd);
+}
+
+static mevel_err_t on_event(mevel_event_t* ev, int flags)
+{
+    if (++dispatched == total) __atomic_store_n(&ev->ctx->running, 0x00, __ATOMIC_RELEASE);
+    return MEVEL_ERR_NONE;
+}
+
+// one call for all ready events of the group instead of one callback per event
+static void on_group(mevel_ctx_t* ctx, mevel_item_t* items, size_t count, void* arg)
+{
+    dispatched += count;
+    if (dispatched >= total) __atomic_store_n(&ctx->running, 0x00, __ATOMIC_RELEASE);
+}
+
+static size_t leaked;
+
+// every item of this batch was deleted by an ungrouped peer before the flush
+static void on_deleted(mevel_ctx_t* ctx, mevel_item_t* items, size_t count, void* arg)
+{
+    for (size_t i = 0; i < count; i++) leaked += (items[i].ev->data != NULL);
+}
+
+// deletes the grouped event collected ahead of it in the batch, then itself
+static mevel_err_t on_peer(mevel_event_t* ev, int flags)
+{
+    mevel_del(ev->ctx, (mevel_event_t*) ev->data);
+    if (--dispatched == 0) __atomic_store_n(&ev->ctx->running, 0x00, __ATOMIC_RELEASE);
+    return MEVEL_ERR_CLOSE;
+}
+
+// pairs of a grouped event and the ungrouped one deleting it; the grouped half is
+// added first, so it is reported and collected first; events come from the heap,
+// so a sanitizer build catches an item handed over after its event was released
+static void bench_group_del(const char* name, size_t pairs, size_t count)
+{
+    mevel_cfg_t cfg = {};
+    cfg.flags       = MEVEL_CTX_NOSLAB;
+    cfg.nevents     = 1024;
+    cfg.maxevents   = 1024;
+
+    mevel_ctx_t*    ctx = mevel_ini_cfg(&cfg);
+    mevel_group_t*  grp = mevel_ini_group(on_deleted, NULL);
+    size_t          ops = 0;
+    uint64_t        ns  = 0;
+
+    if (ctx == NULL || grp == NULL) return;
+    if (pairs > (size_t) cfg.nevents / 2) pairs = (size_t) cfg.nevents / 2;
+
+    std::vector<mevel_event_t*> evs(pairs);
+
+    leaked = 0;
+
+    for (; ops < count; ops += pairs)
+    {
+        for (size_t i = 0; i < pairs; i++)
+        {
+            evs[i] = mevel_ini_fio(ctx, on_event, eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC), MEVEL_READ);
+            evs[i]->data = evs[i];
+            mevel_set_group(evs[i], grp);
+            mevel_add(ctx, evs[i]);
+        }
+
+        for (size_t i = 0; i < pairs; i++)
+        {
+            mevel_event_t* ev = mevel_ini_fio(ctx, on_peer, eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC), MEVEL_READ);
+            ev->data = evs[i];
+            mevel_add(ctx, ev);
+        }
+
+        dispatched = pairs;
+
+        uint64_t t0 = bench_ns();
+        mevel_run(ctx);
+        ns += bench_ns() - t0;
+    }
+
+    bench_report(name, ops, ns);
+
+    if (leaked) fprintf(stderr, "%s: %zu deleted events handed to the group handler\n", name, leaked);
+
+    mevel_rel(ctx);
+    mevel_rel_group(grp);
+
+    if (leaked) exit(EXIT_FAILURE);
+}
+
+static void bench_c(const char* name, size_t fds, size_t count, int flags, bool group = false)
+{
+    mevel_cfg_t cfg = {};
+    cfg.flags       = flags;
+    cfg.nevents     = 1024;
+    cfg.maxevents   = 1024;
+
+    mevel_ctx_t* ctx = mevel_ini_cfg(&cfg);
+
+    if (ctx == NULL) return;
+
+    mevel_group_t* grp = group ? mevel_ini_group(on_group, NULL) : NULL;
+
+    dispatched  = 0;
+    total       = count;
+
+    for (size_t i = 0; i < fds; i++)
+    {
+        mevel_event_t* ev = mevel_ini_fio(ctx, on_event, eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC), MEVEL_READ);
+
+        mevel_set_group(ev, grp);
+        mevel_add(ctx, ev);
+    }
+
+    uint64_t t0 = bench_ns();
+    mevel_run(ctx);
+    bench_report(name, dispatched, bench_ns() - t0);
+
+    // mevel_rel does not close the descriptors of the registered events
+    for (mevel_event_t* ev = ctx->evs; ev; ev = ev->nxt) close(ev->fd);
+    mevel_rel(ctx);
+    mevel_rel_group(grp);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t fds      = (argc > 1) ? (size_t) atoll(argv[1]) : 1000;
+    size_t count    = (argc > 2) ? (size_t) atoll(argv[2]) : 2000000;
+
+    bench_nofile(fds + 64);
+
+    bench_cxx("c++ dispatch", fds, count, 0);
+    bench_cxx("c++ dispatch (metrics)", fds, count, MEVEL_CTX_METRICS);
+    bench_cxx("c++ dispatch (trace)", fds, count, MEVEL_CTX_TRACE);
+    bench_c("c dispatch", fds, count, 0);
+    bench_c("c dispatch (metrics)", fds, count, MEVEL_CTX_METRICS);
+    bench_c("c dispatch (trace)", fds, count, MEVEL_CTX_TRACE);
+    bench_c("c dispatch (group)", fds, count, 0, true);
+    bench_group_del("c dispatch (group delete)", 256, count / 10);
+
+    return 0;
+}
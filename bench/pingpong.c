@@ -0,0 +1,174 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+// round trip latency of a blocking client against an echo server on the loop,
+// over loopback TCP and over a unix socket
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <mevel.h>
+
+#include "bench.h"
+
+#define PING_PATH   "/tmp/mevel_bench_ping.sock"
+#define PING_SIZE   64
+
+typedef struct {
+    mevel_ctx_t*    ctx;
+    int             stype;
+    int             port;
+    size_t          count;
+    hist_t          lat;
+} ping_t;
+
+static mevel_err_t on_echo(mevel_event_t* ev, int flags)
+{
+    char    buf[PING_SIZE];
+    ssize_t len = read(ev->fd, buf, sizeof(buf));
+
+    if (len == 0 || (len < 0 && errno != EAGAIN)) return MEVEL_ERR_CLOSE;
+    if (len > 0 && write(ev->fd, buf, len) != len) return MEVEL_ERR_CLOSE;
+
+    return MEVEL_ERR_NONE;
+}
+
+static int ping_connect(ping_t* ping)
+{
+    int fd = socket(ping->stype, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (ping->stype == MEVEL_UNIX)
+    {
+        struct sockaddr_un addr;
+
+        memset(&addr, 0x00, sizeof(struct sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, PING_PATH, sizeof(addr.sun_path) - 1);
+
+        if (connect(fd, (struct sockaddr*) &addr, sizeof(struct sockaddr_un)) == 0) return fd;
+    }
+    else
+    {
+        struct sockaddr_in addr;
+        int one = 1;
+
+        memset(&addr, 0x00, sizeof(struct sockaddr_in));
+        addr.sin_family         = AF_INET;
+        addr.sin_port           = htons(ping->port);
+        addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(int));
+
+        if (connect(fd, (struct sockaddr*) &addr, sizeof(struct sockaddr_in)) == 0) return fd;
+    }
+
+    close(fd);
+    return -1;
+}
+
+static void* client(void* arg)
+{
+    ping_t* ping    = (ping_t*) arg;
+    char    buf[PING_SIZE];
+    int     fd      = ping_connect(ping);
+
+    memset(buf, 0x5a, sizeof(buf));
+
+    for (size_t i = 0; fd >= 0 && i < ping->count; i++)
+    {
+        uint64_t    t0  = bench_ns();
+        size_t      got = 0;
+
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf)) break;
+
+        while (got < sizeof(buf))
+        {
+            ssize_t len = read(fd, buf + got, sizeof(buf) - got);
+            if (len <= 0) break;
+            got += len;
+        }
+
+        if (got < sizeof(buf)) break;
+
+        hist_add(&ping->lat, bench_ns() - t0);
+    }
+
+    if (fd >= 0) close(fd);
+    else fprintf(stderr, "ping-pong: can not connect\n");
+
+    mevel_stp(ping->ctx);
+
+    return NULL;
+}
+
+static void bench_ping(const char* name, int flags, int stype, int port, size_t count)
+{
+    mevel_cfg_t     cfg;
+    ping_t          ping;
+    pthread_t       thread;
+
+    memset(&cfg, 0x00, sizeof(mevel_cfg_t));
+    cfg.flags       = flags;
+
+    memset(&ping, 0x00, sizeof(ping_t));
+    hist_ini(&ping.lat);
+    ping.ctx        = mevel_ini_cfg(&cfg);
+    ping.stype      = stype;
+    ping.port       = port;
+    ping.count      = count;
+
+    unlink(PING_PATH);
+
+    if (ping.ctx == NULL ||
+        mevel_add_tcp(ping.ctx, on_echo, stype, (stype == MEVEL_UNIX) ? PING_PATH : "127.0.0.1", port, MEVEL_READ) != MEVEL_ERR_NONE)
+    {
+        fprintf(stderr, "%s: can not listen\n", name);
+        mevel_rel(ping.ctx);
+        return;
+    }
+
+    uint64_t t0 = bench_ns();
+    pthread_create(&thread, NULL, client, &ping);
+    mevel_run(ping.ctx);
+    pthread_join(thread, NULL);
+    bench_report_lat(name, (size_t) ping.lat.count, bench_ns() - t0, &ping.lat);
+
+    mevel_rel(ping.ctx);
+    unlink(PING_PATH);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t  count   = (argc > 1) ? (size_t) atoll(argv[1]) : 100000;
+    int     port    = (argc > 2) ? atoi(argv[2]) : 47701;
+
+    // mevel_rel leaves the sockets of the events open, so every TCP run takes a port of its own
+    bench_ping("tcp ping-pong", 0, MEVEL_IPV4, port, count);
+    bench_ping("unix ping-pong", 0, MEVEL_UNIX, 0, count);
+    bench_ping("tcp ping-pong (uring)", MEVEL_CTX_URING, MEVEL_IPV4, port + 1, count);
+    bench_ping("unix ping-pong (uring)", MEVEL_CTX_URING, MEVEL_UNIX, 0, count);
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+// cost of mevel_add and mevel_del while the context holds 10k to 1M registrations;
+// the context is filled untimed, then one more registration is added and deleted
+// at a time so every sample is taken at the same size. File events are duplicates
+// of one eventfd, so their number is bound by RLIMIT_NOFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <mevel.h>
+
+#include "bench.h"
+
+#define SCALE_SAMPLES   10000
+
+static mevel_err_t on_event(mevel_event_t* ev, int flags)
+{
+    return MEVEL_ERR_NONE;
+}
+
+static mevel_event_t* new_fio(mevel_ctx_t* ctx, int base, size_t i)
+{
+    return mevel_ini_fio(ctx, on_event, dup(base), MEVEL_READ);
+}
+
+static mevel_event_t* new_timer(mevel_ctx_t* ctx, int base, size_t i)
+{
+    return mevel_ini_timer(ctx, on_event, 1000 + (int)(i % 100000), 0);
+}
+
+// times SCALE_SAMPLES add and del pairs on a context holding count events;
+// mevel_del releases the event and closes its descriptor
+static void bench_steady(mevel_ctx_t* ctx, const char* what, size_t count, int base,
+    mevel_event_t* (*ini)(mevel_ctx_t*, int, size_t))
+{
+    mevel_event_t** evs = (mevel_event_t**) malloc(count * sizeof(mevel_event_t*));
+    hist_t          add, del;
+    char            name[64];
+    uint64_t        t0, t1, t2, nsadd = 0, nsdel = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        evs[i] = ini(ctx, base, i);
+        mevel_add(ctx, evs[i]);
+    }
+
+    hist_ini(&add);
+    hist_ini(&del);
+    for (size_t i = 0; i < SCALE_SAMPLES; i++)
+    {
+        mevel_event_t* ev = ini(ctx, base, count + i);
+
+        t0 = bench_ns();
+        mevel_add(ctx, ev);
+        t1 = bench_ns();
+        mevel_del(ctx, ev);
+        t2 = bench_ns();
+
+        hist_add(&add, t1 - t0);
+        hist_add(&del, t2 - t1);
+        nsadd += t1 - t0;
+        nsdel += t2 - t1;
+    }
+
+    snprintf(name, sizeof(name), "%s add at %zu", what, count);
+    bench_report_lat(name, SCALE_SAMPLES, nsadd, &add);
+    snprintf(name, sizeof(name), "%s del at %zu", what, count);
+    bench_report_lat(name, SCALE_SAMPLES, nsdel, &del);
+
+    for (size_t i = 0; i < count; i++) mevel_del(ctx, evs[i]);
+
+    free(evs);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t  most    = (argc > 1) ? (size_t) atoll(argv[1]) : 1000000;
+    size_t  limit   = bench_nofile(most + 64);
+    int     base    = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    for (size_t count = 10000; count <= most; count *= 10)
+    {
+        mevel_ctx_t* ctx = mevel_ini();
+
+        if (ctx == NULL) return EXIT_FAILURE;
+
+        if (count + 64 <= limit) bench_steady(ctx, "fd", count, base, new_fio);
+        else fprintf(stderr, "fd add at %zu: RLIMIT_NOFILE allows only %zu\n", count, limit - 64);
+
+        bench_steady(ctx, "timer", count, base, new_timer);
+
+        mevel_rel(ctx);
+    }
+
+    close(base);
+
+    return EXIT_SUCCESS;
+}
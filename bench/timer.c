@@ -0,0 +1,140 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+// compares one timerfd per timer against the timer wheel of the context
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+
+#include <mevel.h>
+
+#include "bench.h"
+
+static size_t           fired;
+static size_t           total;
+static mevel_ctx_t*     ctx;
+
+static void tfd_set(int fd, int timeout)
+{
+    struct itimerspec itime = {{0, 0}, {timeout / 1000, (timeout % 1000) * 1000000L}};
+    timerfd_settime(fd, 0, &itime, NULL);
+}
+
+static void bench_timerfd(size_t count)
+{
+    int*            fds     = (int*) malloc(count * sizeof(int));
+    int             epollfd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event_t   events[256];
+    uint64_t        t0;
+
+    t0 = bench_ns();
+    for (size_t i = 0; i < count; i++)
+    {
+        epoll_event_t ev = {EPOLLIN, {.u64 = i}};
+        fds[i] = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        tfd_set(fds[i], 1000 + (int)(i % 1000));
+        epoll_ctl(epollfd, EPOLL_CTL_ADD, fds[i], &ev);
+    }
+    bench_report("timerfd arm", count, bench_ns() - t0);
+
+    t0 = bench_ns();
+    for (size_t i = 0; i < count; i++) tfd_set(fds[i], 2000 + (int)(i % 1000));
+    bench_report("timerfd reschedule", count, bench_ns() - t0);
+
+    t0 = bench_ns();
+    for (size_t i = 0; i < count; i++) tfd_set(fds[i], 0);
+    bench_report("timerfd cancel", count, bench_ns() - t0);
+
+    for (size_t i = 0; i < count; i++) tfd_set(fds[i], 1 + (int)(i % 16));
+
+    t0 = bench_cpu_ns();
+    for (size_t done = 0; done < count;)
+    {
+        int nfds = epoll_wait(epollfd, events, 256, 100);
+        for (int n = 0; n < nfds; n++)
+        {
+            uint64_t exp;
+            if (read(fds[events[n].data.u64], &exp, sizeof(exp)) == sizeof(exp)) done++;
+        }
+    }
+    bench_report("timerfd fire (cpu)", count, bench_cpu_ns() - t0);
+
+    for (size_t i = 0; i < count; i++) close(fds[i]);
+    close(epollfd);
+    free(fds);
+}
+
+static mevel_err_t on_timer(mevel_event_t* ev, int exp)
+{
+    if (++fired == total) ctx->running = 0x00;
+    return MEVEL_ERR_NONE;
+}
+
+static void bench_wheel(size_t count)
+{
+    mevel_event_t** evs = (mevel_event_t**) malloc(count * sizeof(mevel_event_t*));
+    uint64_t        t0;
+
+    ctx = mevel_ini();
+
+    t0 = bench_ns();
+    for (size_t i = 0; i < count; i++)
+    {
+        evs[i] = mevel_ini_timer(ctx, on_timer, 1000 + (int)(i % 1000), 0);
+        mevel_add(ctx, evs[i]);
+    }
+    bench_report("wheel arm", count, bench_ns() - t0);
+
+    t0 = bench_ns();
+    for (size_t i = 0; i < count; i++) mevel_set_timer(ctx, evs[i], 2000 + (int)(i % 1000), 0);
+    bench_report("wheel reschedule", count, bench_ns() - t0);
+
+    t0 = bench_ns();
+    for (size_t i = 0; i < count; i++) mevel_clr_timer(ctx, evs[i]);
+    bench_report("wheel cancel", count, bench_ns() - t0);
+
+    for (size_t i = 0; i < count; i++) mevel_set_timer(ctx, evs[i], 1 + (int)(i % 16), 0);
+
+    fired = 0;
+    total = count;
+    t0 = bench_cpu_ns();
+    mevel_run(ctx);
+    bench_report("wheel fire (cpu)", count, bench_cpu_ns() - t0);
+
+    mevel_rel(ctx);
+    free(evs);
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = (argc > 1) ? (size_t) atol(argv[1]) : 100000;
+    size_t limit = bench_nofile(count + 64);
+
+    if (limit < count + 64)
+    {
+        fprintf(stderr, "timerfd: RLIMIT_NOFILE allows only %zu timers\n", limit - 64);
+        bench_timerfd(limit - 64);
+    }
+    else bench_timerfd(count);
+
+    bench_wheel(count);
+
+    return EXIT_SUCCESS;
+}
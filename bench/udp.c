@@ -0,0 +1,185 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+// UDP echo throughput over loopback with a window of datagrams in flight; the
+// server answers one datagram per system call or a batch with recvmmsg/sendmmsg;
+// the latencies include the time spent queued behind the rest of the window
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <mevel.h>
+
+#include "bench.h"
+
+#define ECHO_SIZE   64
+#define ECHO_WINDOW 32
+
+typedef struct {
+    mevel_ctx_t*    ctx;
+    int             port;
+    size_t          count;
+    size_t          lost;
+    hist_t          lat;
+} echo_t;
+
+static mevel_err_t on_dgram(mevel_event_t* ev, int flags)
+{
+    char                    buf[ECHO_SIZE];
+    struct sockaddr_storage addr;
+    socklen_t               alen;
+    ssize_t                 len;
+
+    // the socket of mevel_add_udp blocks; drain it without waiting
+    for (;;)
+    {
+        alen = sizeof(struct sockaddr_storage);
+        len  = recvfrom(ev->fd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr*) &addr, &alen);
+
+        if (len < 0) break;
+
+        if (sendto(ev->fd, buf, len, 0, (struct sockaddr*) &addr, alen) < 0) break;
+    }
+
+    return MEVEL_ERR_NONE;
+}
+
+static mevel_err_t on_batch(mevel_event_t* ev, int count)
+{
+    for (int indx = 0; indx < count; indx++)
+    {
+        size_t  len;
+        void*   buf = mevel_dgram_data(ev, indx, &len);
+
+        mevel_dgram_reply(ev, indx, buf, len);
+    }
+
+    return MEVEL_ERR_NONE;
+}
+
+// every datagram carries its send time, so late replies are still measured
+static int echo_send(int fd)
+{
+    char        buf[ECHO_SIZE];
+    uint64_t    now = bench_ns();
+
+    memset(buf, 0x5a, sizeof(buf));
+    memcpy(buf, &now, sizeof(uint64_t));
+
+    return (send(fd, buf, sizeof(buf), 0) == sizeof(buf)) ? 0 : -1;
+}
+
+static void* client(void* arg)
+{
+    echo_t*             echo    = (echo_t*) arg;
+    struct sockaddr_in  addr;
+    struct timeval      tv      = {0, 50000};
+    char                buf[ECHO_SIZE];
+    size_t              sent    = 0;
+    size_t              done    = 0;
+    int                 fd      = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+    memset(&addr, 0x00, sizeof(struct sockaddr_in));
+    addr.sin_family         = AF_INET;
+    addr.sin_port           = htons(echo->port);
+    addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval));
+
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(struct sockaddr_in)) < 0) done = echo->count;
+
+    while (sent < echo->count && sent < ECHO_WINDOW && echo_send(fd) == 0) sent++;
+
+    while (done < echo->count)
+    {
+        uint64_t    stamp;
+        ssize_t     len = recv(fd, buf, sizeof(buf), 0);
+
+        if (len < (ssize_t) sizeof(uint64_t))
+        {
+            // nothing came back in time; the window is lost, refill it
+            echo->lost += sent - done;
+            done        = sent;
+        }
+        else
+        {
+            memcpy(&stamp, buf, sizeof(uint64_t));
+            hist_add(&echo->lat, bench_ns() - stamp);
+            done++;
+        }
+
+        while (sent < echo->count && sent - done < ECHO_WINDOW && echo_send(fd) == 0) sent++;
+    }
+
+    close(fd);
+    mevel_stp(echo->ctx);
+
+    return NULL;
+}
+
+static void bench_echo(const char* name, int batch, int port, size_t count)
+{
+    echo_t          echo;
+    pthread_t       thread;
+    mevel_err_t     err;
+
+    memset(&echo, 0x00, sizeof(echo_t));
+    hist_ini(&echo.lat);
+    echo.ctx    = mevel_ini();
+    echo.port   = port;
+    echo.count  = count;
+
+    if (echo.ctx == NULL) return;
+
+    if (batch)  err = mevel_add_udp_dgram(echo.ctx, on_batch, MEVEL_IPV4, "127.0.0.1", port);
+    else        err = mevel_add_udp(echo.ctx, on_dgram, MEVEL_IPV4, "127.0.0.1", port, MEVEL_READ);
+
+    if (err != MEVEL_ERR_NONE)
+    {
+        fprintf(stderr, "%s: can not bind port %d\n", name, port);
+        mevel_rel(echo.ctx);
+        return;
+    }
+
+    uint64_t t0 = bench_ns();
+    pthread_create(&thread, NULL, client, &echo);
+    mevel_run(echo.ctx);
+    pthread_join(thread, NULL);
+    bench_report_lat(name, (size_t) echo.lat.count, bench_ns() - t0, &echo.lat);
+
+    if (echo.lost) fprintf(stderr, "%s: %zu datagrams lost\n", name, echo.lost);
+
+    mevel_rel(echo.ctx);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t  count   = (argc > 1) ? (size_t) atoll(argv[1]) : 200000;
+    int     port    = (argc > 2) ? atoi(argv[2]) : 47702;
+
+    // mevel_rel leaves the sockets of the events open, so every run takes a port of its own
+    bench_echo("udp echo", 0, port, count);
+    bench_echo("udp echo (mmsg)", 1, port + 1, count);
+
+    return 0;
+}
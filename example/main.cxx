@@ -26,7 +26,8 @@ mevel::error_en  timer(const mevel::mevent& ev, int flags)
     static uint64_t exp = 0;
     static uint64_t tot_exp = 0;
 
-    if (read(ev.fd, &exp, sizeof(uint64_t)) != sizeof(uint64_t)) return mevel::MEVEL_ERR_TIMER;
+    // timer callbacks receive the number of expirations
+    exp = static_cast<uint64_t>(flags);
 
     tot_exp += exp;
     printf("read: %llu; total=%llu\n", (unsigned long long) exp, (unsigned long long) tot_exp);
@@ -0,0 +1,714 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __CORO_H__
+#define __CORO_H__
+
+// C++20 coroutines on top of mevel::mevel. The library is built as C++11;
+// only translation units that include this header need -std=c++20.
+//
+//  mevel::task<> session(mevel::coro& io, int fd)
+//  {
+//      char buf[512];
+//      ssize_t len;
+//      while ((len = co_await io.read(fd, buf, sizeof(buf))) > 0)
+//      {
+//          if (co_await io.write(fd, buf, len) < 0) break;
+//      }
+//      io.close(fd);
+//  }
+//
+//  io.spawn(session(io, fd));
+
+#if __cplusplus < 202002L
+#error "coro.h requires C++20"
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "mevel.h"
+
+#define MEVEL_CORO_CLASSES  7       // pooled frame sizes, 64 to 4096 bytes
+#define MEVEL_CORO_CHUNK    64      // frames per pool chunk
+
+namespace mevel
+{
+
+class coro;
+
+void* coro_frame(size_t size);
+
+template <typename T>
+class task;
+
+// frames come from the pool of the coro living on the calling thread, from the
+// heap when there is none; slab_put returns either kind
+struct promise_base_t
+{
+    std::coroutine_handle<>     cont;       // awaiting coroutine, none for spawned tasks
+    std::exception_ptr          error;
+    coro*                       owner;      // loop of a spawned task
+    promise_base_t*             nxt;        // spawned tasks of the loop
+    promise_base_t*             prv;
+
+    promise_base_t()
+    : owner(nullptr)
+    , nxt(nullptr)
+    , prv(nullptr)
+    {
+    }
+
+    static void* operator new(size_t size)
+    {
+        return coro_frame(size);
+    }
+
+    static void operator delete(void* ptr, size_t)
+    {
+        slab_put(ptr);
+    }
+
+    struct final_t
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept;
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    final_t final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        error = std::current_exception();
+    }
+};
+
+template <typename T>
+struct promise_value_t
+{
+    std::optional<T>            value;
+
+    template <typename U>
+    void return_value(U&& val)
+    {
+        value.emplace(std::forward<U>(val));
+    }
+
+    T get()
+    {
+        return std::move(*value);
+    }
+};
+
+template <>
+struct promise_value_t<void>
+{
+    void return_void()
+    {
+    }
+
+    void get()
+    {
+    }
+};
+
+/**
+ * @brief task is a lazily started coroutine; it runs when awaited, or when handed
+ * to coro::spawn, and owns its frame until then
+ */
+template <typename T = void>
+class task
+{
+public:
+
+    struct promise_type : promise_base_t, promise_value_t<T>
+    {
+        task get_return_object()
+        {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    typedef std::coroutine_handle<promise_type> handle_t;
+
+    task() noexcept
+    : handle()
+    {
+    }
+
+    task(task&& other) noexcept
+    : handle(std::exchange(other.handle, nullptr))
+    {
+    }
+
+    task& operator=(task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    ~task()
+    {
+        if (handle) handle.destroy();
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct awaiter_t
+        {
+            handle_t    handle;
+
+            bool await_ready() noexcept
+            {
+                return !handle || handle.done();
+            }
+
+            // the awaiting coroutine is resumed from the final suspend point
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) noexcept
+            {
+                handle.promise().cont = cont;
+                return handle;
+            }
+
+            T await_resume()
+            {
+                if (handle.promise().error) std::rethrow_exception(handle.promise().error);
+                return handle.promise().get();
+            }
+        };
+
+        return awaiter_t{handle};
+    }
+
+    handle_t release() noexcept
+    {
+        return std::exchange(handle, nullptr);
+    }
+
+private:
+
+    explicit task(handle_t h) noexcept
+    : handle(h)
+    {
+    }
+
+    handle_t    handle;
+};
+
+// a read, write or accept waiting for readiness; perform tries the system call
+// and returns false while it would block
+struct io_op_t
+{
+    coro*                       io;
+    int                         fd;
+    bool                        rd;
+    ssize_t                     ret;
+    int                         err;
+    std::coroutine_handle<>     handle;
+    bool                        (*perform)(io_op_t*);
+
+    io_op_t(coro* io, int fd, bool rd, bool (*perform)(io_op_t*))
+    : io(io)
+    , fd(fd)
+    , rd(rd)
+    , ret(-1)
+    , err(0)
+    , handle()
+    , perform(perform)
+    {
+    }
+
+    // the call is tried first; the coroutine only suspends when it would block
+    bool await_ready()
+    {
+        return perform(this);
+    }
+
+    bool await_suspend(std::coroutine_handle<> h);
+
+    ssize_t await_resume()
+    {
+        if (ret < 0) errno = err;
+        return ret;
+    }
+
+    bool done(ssize_t res)
+    {
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+
+        ret = res;
+        err = (res < 0) ? errno : 0;
+        return true;
+    }
+};
+
+struct read_op : io_op_t
+{
+    void*       buf;
+    size_t      len;
+
+    read_op(coro* io, int fd, void* buf, size_t len)
+    : io_op_t(io, fd, true, &read_op::run)
+    , buf(buf)
+    , len(len)
+    {
+    }
+
+    static bool run(io_op_t* op)
+    {
+        read_op* self = static_cast<read_op*>(op);
+        ssize_t  res;
+
+        do res = ::read(self->fd, self->buf, self->len);
+        while (res < 0 && errno == EINTR);
+
+        return self->done(res);
+    }
+};
+
+struct write_op : io_op_t
+{
+    const char* buf;
+    size_t      len;
+    size_t      off;
+
+    write_op(coro* io, int fd, const void* buf, size_t len)
+    : io_op_t(io, fd, false, &write_op::run)
+    , buf(static_cast<const char*>(buf))
+    , len(len)
+    , off(0)
+    {
+    }
+
+    // writes everything; a closed peer is an EPIPE error rather than a SIGPIPE
+    static bool run(io_op_t* op)
+    {
+        write_op* self = static_cast<write_op*>(op);
+
+        while (self->off < self->len)
+        {
+            ssize_t res = ::send(self->fd, self->buf + self->off, self->len - self->off, MSG_NOSIGNAL);
+
+            if (res < 0 && errno == ENOTSOCK) res = ::write(self->fd, self->buf + self->off, self->len - self->off);
+
+            if (res < 0 && errno == EINTR) continue;
+            if (res < 0) return self->done(res);
+
+            self->off += res;
+        }
+
+        return self->done(static_cast<ssize_t>(self->len));
+    }
+};
+
+struct accept_op : io_op_t
+{
+    accept_op(coro* io, int fd)
+    : io_op_t(io, fd, true, &accept_op::run)
+    {
+    }
+
+    static bool run(io_op_t* op)
+    {
+        int res;
+
+        do res = ::accept4(op->fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        while (res < 0 && (errno == EINTR || errno == ECONNABORTED));
+
+        return op->done(res);
+    }
+};
+
+struct sleep_op
+{
+    // owned by the timer event, which may outlive the awaiting frame
+    struct node_t
+    {
+        sleep_op*   op;
+    };
+
+    coro*                       io;
+    int                         timeout;
+    node_t*                     node;
+    std::coroutine_handle<>     handle;
+
+    sleep_op(coro* io, int timeout)
+    : io(io)
+    , timeout(timeout)
+    , node(nullptr)
+    , handle()
+    {
+    }
+
+    sleep_op(const sleep_op&) = delete;
+    sleep_op& operator=(const sleep_op&) = delete;
+
+    ~sleep_op()
+    {
+        if (node) node->op = nullptr;
+    }
+
+    // resumes the sleeper unless it was destroyed meanwhile
+    static void wake(node_t& node)
+    {
+        sleep_op* op = node.op;
+
+        if (op)
+        {
+            node.op     = nullptr;
+            op->node    = nullptr;
+            op->handle.resume();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return timeout < 0;
+    }
+
+    bool await_suspend(std::coroutine_handle<> h);
+
+    void await_resume() const noexcept
+    {
+    }
+};
+
+/**
+ * @brief coro runs coroutines on a mevel::mevel; they are resumed from its callbacks
+ * on readiness, so no thread is involved. File descriptors are nonblocking, are
+ * registered edge-triggered on their first wait and have to be closed with close().
+ * One read and one write (or accept) may wait on a descriptor at a time.
+ * Coroutine frames created on the thread of a coro come from its pool while it lives.
+ * The coro has to be destroyed before its loop and after every task created
+ * under it; spawned tasks still suspended then are destroyed with it.
+ */
+class coro
+{
+public:
+
+    explicit coro(mevel& loop)
+    : loop(loop)
+    , tasks(nullptr)
+    , prev(self)
+    {
+        self = this;
+
+        for (int indx = 0; indx < MEVEL_CORO_CLASSES; indx++)
+        {
+            slabs[indx] = slab_ini(static_cast<size_t>(64) << indx, 0, MEVEL_CORO_CHUNK);
+        }
+    }
+
+    coro(const coro&) = delete;
+    coro& operator=(const coro&) = delete;
+
+    ~coro()
+    {
+        while (tasks)
+        {
+            promise_base_t* promise = tasks;
+            unlink(promise);
+            task<void>::handle_t::from_promise(*static_cast<task<void>::promise_type*>(promise)).destroy();
+        }
+
+        for (size_t fd = 0; fd < waiters.size(); fd++)
+        {
+            if (waiters[fd].armed) loop.del_fio(static_cast<int>(fd));
+        }
+
+        for (int indx = 0; indx < MEVEL_CORO_CLASSES; indx++) slab_rel(slabs[indx]);
+
+        self = prev;
+    }
+
+    mevel& get_loop() noexcept
+    {
+        return loop;
+    }
+
+    // starts a task and lets it run to completion on its own; it must not throw
+    void spawn(task<void>&& tsk)
+    {
+        std::coroutine_handle<task<void>::promise_type> handle = tsk.release();
+
+        if (!handle) return;
+
+        promise_base_t& promise = handle.promise();
+
+        promise.owner   = this;
+        promise.nxt     = tasks;
+        if (tasks) tasks->prv = &promise;
+        tasks           = &promise;
+
+        handle.resume();
+    }
+
+    // like ::read; -1 with errno on failure
+    read_op read(int fd, void* buf, size_t len)
+    {
+        return read_op(this, fd, buf, len);
+    }
+
+    // writes all of buf unless an error comes first; len or -1 with errno
+    write_op write(int fd, const void* buf, size_t len)
+    {
+        return write_op(this, fd, buf, len);
+    }
+
+    // a nonblocking connection from a nonblocking listener, or -1 with errno
+    accept_op accept(int fd)
+    {
+        return accept_op(this, fd);
+    }
+
+    // a timeout of 0 yields until the events of the current iteration are dispatched
+    sleep_op sleep_for(int timeout)
+    {
+        return sleep_op(this, timeout);
+    }
+
+    // closes fd; operations waiting on it fail with ECANCELED
+    bool close(int fd)
+    {
+        waiter_t waiter = {};
+
+        if (fd >= 0 && static_cast<size_t>(fd) < waiters.size() && waiters[fd].armed)
+        {
+            waiter = waiters[fd];
+            waiters[fd] = waiter_t();
+            loop.del_fio(fd);
+        }
+
+        bool ret = (::close(fd) == 0);
+
+        for (io_op_t* op : {waiter.rd, waiter.wr})
+        {
+            if (op == nullptr) continue;
+
+            op->ret = -1;
+            op->err = ECANCELED;
+            op->handle.resume();
+        }
+
+        return ret;
+    }
+
+private:
+
+    friend struct io_op_t;
+    friend void* coro_frame(size_t);
+    friend struct sleep_op;
+    friend struct promise_base_t::final_t;
+
+    struct waiter_t
+    {
+        io_op_t*    rd;
+        io_op_t*    wr;
+        bool        armed;      // registered with the loop
+    };
+
+    mevel&                  loop;
+    std::vector<waiter_t>   waiters;    // indexed by fd
+    promise_base_t*         tasks;      // spawned and not finished
+    slab_ctx_t*             slabs[MEVEL_CORO_CLASSES];
+    coro*                   prev;       // coro of the thread before this one
+
+    static inline thread_local coro* self = nullptr;
+
+    void* frame(size_t size)
+    {
+        int indx = 0;
+
+        while (indx < MEVEL_CORO_CLASSES && (static_cast<size_t>(64) << indx) < size) indx++;
+
+        return (indx < MEVEL_CORO_CLASSES) ? slab_get(slabs[indx]) : slab_heap(size);
+    }
+
+    void unlink(promise_base_t* promise)
+    {
+        if (promise->prv) promise->prv->nxt = promise->nxt;
+        else tasks = promise->nxt;
+        if (promise->nxt) promise->nxt->prv = promise->prv;
+
+        promise->owner  = nullptr;
+        promise->nxt    = nullptr;
+        promise->prv    = nullptr;
+    }
+
+    bool wait(io_op_t* op)
+    {
+        int fd = op->fd;
+
+        if (fd < 0)
+        {
+            op->err = EBADF;
+            return false;
+        }
+
+        if (static_cast<size_t>(fd) >= waiters.size()) waiters.resize(fd + 1);
+
+        if ((op->rd ? waiters[fd].rd : waiters[fd].wr) != nullptr)
+        {
+            op->err = EBUSY;
+            return false;
+        }
+
+        // both directions stay registered, so waiting costs no system call
+        if (!waiters[fd].armed)
+        {
+            errno = 0;
+
+            if (!loop.add_fio([this, fd](const mevent&, int flags) { ready(fd, flags); return MEVEL_ERR_NONE; },
+                              fd, MEVEL_READ | MEVEL_WRITE | MEVEL_RDHUP | MEVEL_EDGE))
+            {
+                op->err = errno ? errno : EEXIST;
+                return false;
+            }
+
+            waiters[fd].armed = true;
+        }
+
+        (op->rd ? waiters[fd].rd : waiters[fd].wr) = op;
+
+        return true;
+    }
+
+    void ready(int fd, int flags)
+    {
+        if (flags & (MEVEL_READ | MEVEL_RDHUP | MEVEL_HUP | MEVEL_ERROR)) finish(fd, true);
+        if (flags & (MEVEL_WRITE | MEVEL_HUP | MEVEL_ERROR)) finish(fd, false);
+    }
+
+    // the resumed coroutine may close fd or grow the table
+    void finish(int fd, bool rd)
+    {
+        if (static_cast<size_t>(fd) >= waiters.size()) return;
+
+        io_op_t* op = rd ? waiters[fd].rd : waiters[fd].wr;
+
+        if (op == nullptr || !op->perform(op)) return;
+
+        (rd ? waiters[fd].rd : waiters[fd].wr) = nullptr;
+        op->handle.resume();
+    }
+};
+
+inline void* coro_frame(size_t size)
+{
+    void* ptr = coro::self ? coro::self->frame(size) : slab_heap(size);
+
+    if (ptr == nullptr) throw std::bad_alloc();
+
+    return ptr;
+}
+
+// a finished task resumes its awaiter; a spawned one has nobody to resume and goes away
+template <typename P>
+std::coroutine_handle<> promise_base_t::final_t::await_suspend(std::coroutine_handle<P> h) noexcept
+{
+    promise_base_t& promise = h.promise();
+
+    if (promise.cont) return promise.cont;
+
+    if (promise.owner)
+    {
+        if (promise.error) std::terminate();
+
+        promise.owner->unlink(&promise);
+        h.destroy();
+    }
+
+    return std::noop_coroutine();
+}
+
+inline bool io_op_t::await_suspend(std::coroutine_handle<> h)
+{
+    handle = h;
+
+    // a failed registration resumes right away with the error
+    return io->wait(this);
+}
+
+inline bool sleep_op::await_suspend(std::coroutine_handle<> h)
+{
+    handle  = h;
+    node    = new node_t{this};
+
+    std::unique_ptr<node_t> owned(node);
+
+    bool ret;
+
+    // the wheel arms positive timeouts only; a yield resumes from a deferred task
+    if (timeout == 0)
+    {
+        ret = io->loop.defer([owned = std::move(owned)]() mutable
+        {
+            sleep_op::wake(*owned);
+        });
+    }
+    else
+    {
+        ret = io->loop.add_timer([owned = std::move(owned)](const mevent&, int) mutable
+        {
+            sleep_op::wake(*owned);
+
+            // one-shot; the event and the node go with it
+            return MEVEL_ERR_STOP;
+        }, timeout, 0);
+    }
+
+    if (!ret) node = nullptr;
+
+    return ret;
+}
+
+} // namespace mevel
+
+#endif // __CORO_H__
@@ -0,0 +1,64 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __HIST_H__
+#define __HIST_H__
+
+#include <stdint.h>
+
+// log-bucketed histogram of 64-bit values; every power of two is split into
+// HIST_SUB linear buckets, so a bucket is within 1/HIST_SUB of its values.
+// Values below HIST_SUB get a bucket each.
+#define HIST_BITS       3
+#define HIST_SUB        (1 << HIST_BITS)
+#define HIST_BUCKETS    ((64 - HIST_BITS + 1) * HIST_SUB)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint64_t        count;
+    uint64_t        sum;
+    uint64_t        max;
+    uint64_t        buckets[HIST_BUCKETS];
+} hist_t;
+
+void            hist_ini(hist_t*);
+
+/**
+ * records a value; hist_add assumes a single writer, hist_add_mt any number of them.
+ * Either may run while another thread takes a snapshot with hist_get.
+ */
+void            hist_add(hist_t*, uint64_t val);
+void            hist_add_mt(hist_t*, uint64_t val);
+
+void            hist_get(const hist_t*, hist_t* snap);
+
+/**
+ * upper bound of the bucket holding the given percentile (0 to 100) of a snapshot
+ */
+uint64_t        hist_pct(const hist_t*, double pct);
+
+int             hist_idx(uint64_t val);
+uint64_t        hist_low(int idx);
+uint64_t        hist_high(int idx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __HIST_H__
@@ -29,28 +29,131 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/epoll.h>
+#include <pthread.h>
 
 #include "types.h"
 #include "queue.h"
+#include "wheel.h"
+#include "uring.h"
+#include "slab.h"
+#include "ring.h"
+#include "mmsg.h"
+#include "mpsc.h"
+#include "hist.h"
+#include "trace.h"
 
 #ifdef __cplusplus
 #include <functional>
-#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <exception>
 #include <string>
 
 extern "C" {
 #endif
 
-// TODO: consider EPOLLEXCLUSIVE and EPOLLONESHOT
-// for multi-threaded solutions.
+typedef struct {
+    int             flags;      // MEVEL_CTX_MT, MEVEL_CTX_URING, MEVEL_CTX_NOSLAB
+    int             backlog;    // listen backlog, 0 for SOMAXCONN
+    int             accepts;    // accepts per listener per iteration, 0 for MEVEL_MAX_ACCEPTS
+    int             nevents;    // initial and minimum epoll batch, 0 for MEVEL_MAX_EVENTS
+    int             maxevents;  // largest adaptive epoll batch, 0 for MEVEL_MAX_BATCH
+    size_t          prealloc;   // events allocated by mevel_ini_cfg
+    size_t          trace;      // records of the trace ring, 0 for MEVEL_TRACE_SIZE
+    size_t          budget;     // bytes a buffered connection reads per turn, 0 for MEVEL_READ_BUDGET
+} mevel_cfg_t;
+
+typedef struct {
+    int             nevents;    // epoll batch size chosen last
+    uint64_t        waits;      // calls into epoll_wait or io_uring_enter
+    uint64_t        full;       // waits that filled the whole batch
+    uint64_t        events;     // events returned by all waits
+} mevel_stats_t;
+
+// opt-in loop instrumentation, see MEVEL_CTX_METRICS; times are in ns
+typedef struct {
+    hist_t          cb[MEVEL_TYPES];    // callback duration by event type - MEVEL_TYPE_IO
+    hist_t          batch;              // events per wakeup
+    hist_t          lag;                // delay of timer callbacks past their deadline
+    uint64_t        wait_ns;            // blocked in epoll_wait or io_uring_enter
+    uint64_t        busy_ns;            // from a wakeup to the next wait
+} mevel_metrics_t;
+
+// adaptive epoll batch; doubles when it keeps coming back full, halves when mostly idle
+typedef struct {
+    int             size;
+    int             min;
+    int             max;
+    int             full;       // consecutive full waits
+    int             idle;       // consecutive waits using less than a quarter
+} mevel_batch_t;
 
 typedef struct {
-    int             epollfd;    // epoll file descriptor
+    int             epollfd;    // epoll file descriptor, -1 with io_uring
+    uring_ctx_t*    uring;      // io_uring backend
     char            running;    // atomic event loop state
-    queue_ctx_t*    qctx;
+    char            stopping;   // atomic; set by mevel_stp, after which the context does not run again
+    int             flags;
+    int             backlog;
+    int             accepts;
+    size_t          budget;     // read budget of buffered connections per turn
+    int             nevents;
+    int             maxevents;
+    mevel_stats_t   stats;      // updated atomically by the loop threads
+    mevel_metrics_t* metrics;   // histograms with MEVEL_CTX_METRICS, NULL otherwise
+    trace_t*        trace;      // callback records with MEVEL_CTX_TRACE, NULL otherwise
+    pthread_mutex_t lock;       // guards the registry, wheel and slab with MEVEL_CTX_MT
+    struct mevel_event* evs;    // registered events, linked through the events
+    size_t          size;       // number of registered events
+    slab_ctx_t*     eslab;      // events
+    wheel_ctx_t*    wheel;      // timers of this context
+    mpsc_t          posts;      // tasks posted by other threads
+    int             postfd;     // eventfd waking the loop for posts and stops
+    mpsc_t          defers;     // tasks run once after the current batch
+    struct mevel_hook* hooks[MEVEL_PHASES]; // phase hooks in registration order
+    int             hooking;    // threads walking the hooks; deleted ones are freed when none is
+    int             dead;       // deleted hooks not freed yet
+    int             idle;       // idle hooks; the loop polls without blocking while there are any
+    struct mevel_event* ready;  // edge-triggered events that yielded with input left, oldest first
+    struct mevel_event* rlast;
+    size_t          nready;
+    int             hifd;       // epoll set of MEVEL_PRIO_HIGH events with MEVEL_CTX_PRIO, -1 otherwise
+    int             prios;      // batches can mix classes and are ordered before dispatch
 } mevel_ctx_t;
 
+typedef struct mevel_hook mevel_hook_t;
+typedef struct mevel_group mevel_group_t;
+
+struct mevel_event;
+struct mevel_job;
+
+typedef void (mevel_sent_fn)(struct mevel_event*, void* arg, int err);
+
+typedef struct {
+    ring_t          in;         // received and not yet consumed
+    ring_t          out;        // queued and not yet sent
+    size_t          low;        // output watermarks, see mevel_conn_wmk
+    size_t          high;
+    int             state;
+    struct mevel_job* jobs;     // queued file regions and zero-copy buffers in output order
+    struct mevel_job* last;
+    size_t          queued;     // bytes ever written to the output ring
+    size_t          sent;       // bytes ever sent from it
+    struct mevel_job* zcs;      // zero-copy buffers sent and not yet released by the kernel
+    struct mevel_job* zlast;
+    uint32_t        zseq;       // zero-copy sends so far
+    uint32_t        zdone;      // zero-copy sends completed
+} mevel_conn_t;
+
+typedef struct {
+    mmsg_t          in;         // received during the callback
+    mmsg_t          out;        // queued replies, allocated on first use
+} mevel_dgram_t;
+
 typedef struct mevel_event {
     mevel_type_t    type;
     mevel_ctx_t*    ctx;
@@ -58,17 +161,71 @@ typedef struct mevel_event {
     sigset_t        smask;
     int             evmask;
     int             fd;
+    wheel_node_t    tnode;      // timer events only
+    void*           data;       // user data, NULL after mevel_ini_*
+    void*           rbuf;       // received data of MEVEL_TYPE_RCV during the callback
+    int             state;      // backend bookkeeping
+    int             prio;       // dispatch class, see mevel_set_prio
+    mevel_group_t*  group;      // batch handler replacing cb, see mevel_set_group
+    mevel_conn_t*   conn;       // buffers of MEVEL_TYPE_CONN
+    mevel_dgram_t*  dgram;      // batches of MEVEL_TYPE_DGRAM
+    struct mevel_event* (*acc)(mevel_ctx_t*, mevel_err_t (*)(struct mevel_event*, int), int, int); // accept hook of listeners
+    struct mevel_event* nxt;    // registry links of the context
+    struct mevel_event* prv;
+    struct mevel_event* rnxt;   // still-ready links of the context
+    struct mevel_event* rprv;
+    int             rflags;     // readiness passed again on the next turn
     mevel_err_t (*cb)(struct mevel_event*, int);
 } mevel_event_t;
 
 typedef mevel_err_t (mevel_cb_t)(mevel_event_t*, int);
 
+// a ready event of a group, see mevel_set_group
+typedef struct {
+    mevel_event_t*  ev;
+    int             flags;      // as passed to a callback
+    mevel_err_t     ret;        // MEVEL_ERR_NONE on entry; set like a callback result
+    mevel_group_t*  group;
+} mevel_item_t;
+
+typedef void (mevel_group_fn)(mevel_ctx_t*, mevel_item_t* items, size_t count, void* arg);
+
+typedef void (mevel_post_fn)(mevel_ctx_t*, void* arg);
+
+typedef void (mevel_task_fn)(void* arg);
+typedef void (mevel_done_fn)(mevel_ctx_t*, void* arg);
+
+typedef struct mevel_exe mevel_exe_t;
+
+typedef struct {
+    mevel_ctx_t*    ctx;
+    pthread_t       thread;
+    int             cpu;        // cpu the loop is pinned to, -1 if not pinned
+    mevel_err_t     ret;        // result of mevel_run on this loop
+} mevel_loop_t;
+
+typedef struct {
+    size_t          size;       // number of loops
+    int             flags;
+    mevel_loop_t*   loops;
+} mevel_grp_t;
+
 /**
  * @brief mevel_ini initializes the context
  *
  */
 mevel_ctx_t*    mevel_ini();
 
+/**
+ * @brief mevel_ini_cfg initializes the context with the given configuration;
+ * with MEVEL_CTX_MT several threads may call mevel_run on the same context,
+ * every fd is armed with EPOLLONESHOT and re-armed after its callback returns;
+ * MEVEL_CTX_URING selects the io_uring backend (single-threaded), which submits
+ * all requests of an iteration with its wait
+ *
+ */
+mevel_ctx_t*    mevel_ini_cfg(const mevel_cfg_t*);
+
 /**
  * @brief mevel_rel releases the context and its allocated resources
  *
@@ -76,26 +233,173 @@ mevel_ctx_t*    mevel_ini();
 void            mevel_rel(mevel_ctx_t*);
 
 /**
- * @brief mevel_run runs the event loop and block
+ * @brief mevel_run runs the event loop and block; a stop is final and wins
+ * over a thread entering the loop later, whereas after an error, such as
+ * MEVEL_ERR_HUP when a signal interrupts the wait, the loop can be run again
  *
  * @return mevel_err_t
  */
 mevel_err_t     mevel_run(mevel_ctx_t*);
 
 /**
- * @brief mevel_add
+ * @brief mevel_stp makes mevel_run return; safe from any thread and wakes
+ * the loop instead of waiting for its timeout
+ *
+ */
+void            mevel_stp(mevel_ctx_t*);
+
+/**
+ * @brief mevel_post runs fn(ctx, arg) on the loop thread; safe from any thread.
+ * Posts are pushed onto a lock-free list and a burst of them costs one eventfd
+ * write; the loop runs them in posting order. Posts still pending when the
+ * context is released are dropped.
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_post(mevel_ctx_t*, mevel_post_fn* fn, void* arg);
+
+/**
+ * @brief mevel_defer runs fn(ctx, arg) once after the events of the current
+ * iteration and the timers due with them are dispatched, e.g. to flush writes
+ * aggregated over a batch. The loop does not block while deferred tasks are
+ * pending, so tasks deferred by a deferred task run in the next iteration.
+ * With MEVEL_CTX_MT the first thread to finish its batch runs them.
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_defer(mevel_ctx_t*, mevel_post_fn* fn, void* arg);
+
+/**
+ * @brief mevel_add_hook calls fn(ctx, arg) in every loop iteration at the given phase
+ * until the hook is deleted:
+ * MEVEL_PHASE_PREP right before the loop waits for events,
+ * MEVEL_PHASE_CHECK after each batch and its deferred tasks,
+ * MEVEL_PHASE_IDLE after a wait that returned no events. Idle hooks keep the
+ * loop polling without blocking, so an idle hook deletes itself once its work is done.
+ * With MEVEL_CTX_MT every loop thread runs the hooks of its own iterations.
+ *
+ * @return the hook or NULL on failure
+ */
+mevel_hook_t*   mevel_add_hook(mevel_ctx_t*, int phase, mevel_post_fn* fn, void* arg);
+
+/**
+ * @brief mevel_del_hook deletes a hook; safe from within the hooks themselves
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_del_hook(mevel_ctx_t*, mevel_hook_t*);
+
+/**
+ * @brief mevel_get_stats copies the loop counters of the context; safe from any thread
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_get_stats(mevel_ctx_t*, mevel_stats_t*);
+
+/**
+ * @brief mevel_get_metrics copies the histograms of a context created with
+ * MEVEL_CTX_METRICS; safe from any thread. The loop reads the clock once per
+ * callback and twice per wait; without MEVEL_CTX_MT it records without atomic
+ * read-modify-writes. Each histogram of the copy is consistent in itself.
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_get_metrics(mevel_ctx_t*, mevel_metrics_t*);
+
+/**
+ * @brief mevel_get_trace copies up to max of the newest records of a context created
+ * with MEVEL_CTX_TRACE, oldest first; safe from any thread. Every callback and every
+ * wait leaves one record with its start and end, see trace_rec_t.
+ *
+ * @return size_t number of records copied
+ */
+size_t          mevel_get_trace(mevel_ctx_t*, trace_rec_t* out, size_t max);
+
+/**
+ * @brief mevel_dump_trace writes the trace ring to fd in the format read by
+ * tool/trace.c, which converts it to Chrome trace JSON; safe from any thread
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_dump_trace(mevel_ctx_t*, int fd);
+
+/**
+ * @brief mevel_batch_ini prepares an adaptive epoll batch between min and max entries
+ *
+ */
+void            mevel_batch_ini(mevel_batch_t*, int min, int max);
+
+/**
+ * @brief mevel_batch_adj accounts for a wait that returned nfds events
+ *
+ * @return int the batch size for the next wait
+ */
+int             mevel_batch_adj(mevel_batch_t*, int nfds);
+
+/**
+ * @brief mevel_add registers an event created by mevel_ini_*. Events are
+ * allocated and released by the library; one filled in by the caller is
+ * refused with MEVEL_ERR_ADD
  *
  * @return mevel_err_t
  */
 mevel_err_t     mevel_add(mevel_ctx_t*, mevel_event_t*);
 
 /**
- * @brief mevel_del
+ * @brief mevel_set_prio sets the dispatch class of an event, MEVEL_PRIO_HIGH to
+ * MEVEL_PRIO_LOW; the epoll backends dispatch each batch by class and keep the
+ * kernel order within a class. With MEVEL_CTX_PRIO high events are also polled
+ * from their own epoll set ahead of every batch, so a saturated batch of bulk
+ * data can not hide them. Connections accepted by a listener take its class.
+ * A registered event of a multi-threaded context can not change its epoll set.
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_set_prio(mevel_ctx_t*, mevel_event_t*, int prio);
+
+/**
+ * @brief mevel_ini_group creates a batch handler; fn(ctx, items, count, arg) is
+ * called once per batch with every ready event of the group, in kernel order,
+ * instead of one callback per event. The handler sets the ret of each item
+ * like a callback result and must not delete the events itself. Events of
+ * the group that are still ready after MEVEL_ERR_AGAIN come one per call.
+ * With MEVEL_CTX_MT every loop thread calls it with the events of its own batch.
+ *
+ * @return the group or NULL on failure
+ */
+mevel_group_t*  mevel_ini_group(mevel_group_fn* fn, void* arg);
+
+/**
+ * @brief mevel_rel_group releases a group once none of its events is registered
+ */
+void            mevel_rel_group(mevel_group_t*);
+
+/**
+ * @brief mevel_set_group hands the readiness of a MEVEL_TYPE_IO event to the
+ * batch handler of a group, or back to its callback with NULL; set it before
+ * mevel_add or from the event's own callback. A listener passes its group on
+ * to the connections it accepts.
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_set_group(mevel_event_t*, mevel_group_t*);
+
+/**
+ * @brief mevel_del unregisters and releases an event; MEVEL_ERR_DEL for an
+ * event the library did not allocate
  *
  * @return mevel_err_t
  */
 mevel_err_t     mevel_del(mevel_ctx_t*, mevel_event_t*);
 
+/**
+ * @brief mevel_rel_ev releases an event created by mevel_ini_* that was never added;
+ * added events are released by mevel_del. Events not allocated by the library are
+ * left alone
+ *
+ */
+void            mevel_rel_ev(mevel_event_t*);
+
 /**
  * @brief mevel_add_fio adds a file I/O event
  *
@@ -104,7 +408,47 @@ mevel_err_t     mevel_del(mevel_ctx_t*, mevel_event_t*);
 mevel_err_t     mevel_add_fio(mevel_ctx_t*, mevel_cb_t, int fd, int evmask);
 
 /**
- * @brief mevel_add_timer
+ * @brief mevel_add_rcv adds a socket whose data is received by the loop; the callback
+ * gets the byte count (0 at end of stream, -errno on error) and the data in ev->rbuf.
+ * The io_uring backend uses a multishot receive into its provided buffer ring.
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_add_rcv(mevel_ctx_t*, mevel_cb_t, int fd);
+
+/**
+ * @brief mevel_add_conn adds a buffered connection on a connected socket, see mevel_ini_conn
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_add_conn(mevel_ctx_t*, mevel_cb_t, int fd);
+
+/**
+ * @brief mevel_add_tcp_conn adds a listener whose accepted sockets become buffered connections
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_add_tcp_conn(mevel_ctx_t*, mevel_cb_t, int stype, const char* straddr, int port);
+
+/**
+ * @brief mevel_add_dgram adds a datagram socket received in batches, see mevel_ini_dgram
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_add_dgram(mevel_ctx_t*, mevel_cb_t, int fd);
+
+/**
+ * @brief mevel_add_udp_dgram binds a datagram socket and adds it as mevel_add_dgram does
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_add_udp_dgram(mevel_ctx_t*, mevel_cb_t, int stype, const char* straddr, int port);
+
+/**
+ * @brief mevel_add_timer adds a timer to the timer wheel of the context;
+ * the callback receives the number of expirations instead of epoll flags.
+ * It may delete its own timer with mevel_del, which is then released once
+ * the callback returns
  *
  * @param timeout specifies the initial expiration of the timer
  * @param period specifies the repeated timer interval
@@ -113,7 +457,24 @@ mevel_err_t     mevel_add_fio(mevel_ctx_t*, mevel_cb_t, int fd, int evmask);
 mevel_err_t     mevel_add_timer(mevel_ctx_t*, mevel_cb_t, int timeout, int period);
 
 /**
- * @brief mevel_add_tcp
+ * @brief mevel_set_timer reschedules a timer in O(1); a zero timeout disarms it
+ *
+ * @param timeout specifies the next expiration of the timer
+ * @param period specifies the repeated timer interval
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_set_timer(mevel_ctx_t*, mevel_event_t*, int timeout, int period);
+
+/**
+ * @brief mevel_clr_timer cancels a timer in O(1) and keeps it registered
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_clr_timer(mevel_ctx_t*, mevel_event_t*);
+
+/**
+ * @brief mevel_add_tcp adds a listener; accepted connections are registered
+ * with the given callback and evmask, the listener itself never calls back
  *
  * @return mevel_err_t
  */
@@ -136,12 +497,183 @@ mevel_err_t     mevel_add_sig(mevel_ctx_t*, mevel_cb_t, int, ...);
 /**
  * @brief mevel_ini_fio creates a file I/O event context
  *
+ * With MEVEL_EDGE the callback drains the fd until EAGAIN; a callback that
+ * stops earlier to leave others a turn returns MEVEL_ERR_AGAIN and is called
+ * again with the same flags before the next wait, without a new notification.
+ *
  * @return mevel_event_t*
  */
 mevel_event_t*  mevel_ini_fio(mevel_ctx_t*, mevel_cb_t, int fd, int evmask);
 
 /**
- * @brief mevel_ini_timer
+ * @brief mevel_ini_rcv creates a receive event, see mevel_add_rcv
+ *
+ * @return mevel_event_t*
+ */
+mevel_event_t*  mevel_ini_rcv(mevel_ctx_t*, mevel_cb_t, int fd);
+
+/**
+ * @brief mevel_ini_conn creates a buffered connection; the loop drains the socket into
+ * an input ring and flushes the output ring with writev, watching EPOLLOUT only while
+ * output is pending. The callback gets MEVEL_READ when new input is buffered, MEVEL_WRITE
+ * when the output fell to the low watermark after passing the high one, MEVEL_RDHUP once
+ * the peer finished sending, and MEVEL_HUP | MEVEL_ERROR on failure, after which the
+ * connection is closed. Returning an error closes it at once, dropping pending output;
+ * MEVEL_ERR_AGAIN calls back again with MEVEL_READ before the next wait while input
+ * is left in the ring.
+ * The signature matches the accept hook of listeners.
+ *
+ * @param evmask extra interest besides MEVEL_READ and MEVEL_RDHUP
+ * @return mevel_event_t*
+ */
+mevel_event_t*  mevel_ini_conn(mevel_ctx_t*, mevel_cb_t, int fd, int evmask);
+
+/**
+ * @brief mevel_conn_read moves up to len buffered input bytes into buf
+ *
+ * @return size_t the number of bytes copied
+ */
+size_t          mevel_conn_read(mevel_event_t*, void* buf, size_t len);
+
+/**
+ * @brief mevel_conn_write queues len bytes for sending; outside the callback of the
+ * connection they are sent right away, inside it once the callback returns
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_conn_write(mevel_event_t*, const void* buf, size_t len);
+
+/**
+ * @brief mevel_conn_sendfile queues len bytes of file fd from offset off behind the
+ * output written so far; the loop sends them with sendfile, resuming on EPOLLOUT, and
+ * calls done with 0 once all are sent or with an errno if the transfer failed, which
+ * also closes the connection. Transfers still queued when the connection is deleted
+ * complete with ECANCELED. done may run before this returns and must not delete the
+ * connection; the file descriptor stays with the caller.
+ *
+ * @param done completion on the loop thread, may be NULL
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_conn_sendfile(mevel_event_t*, int fd, off_t off, size_t len, mevel_sent_fn* done, void* arg);
+
+/**
+ * @brief mevel_conn_sendzc queues len bytes of buf behind the output written so far and
+ * sends them with MSG_ZEROCOPY; the kernel reports on the error queue when it no longer
+ * needs the pages, and the loop calls done then, so buf must stay untouched until done.
+ * Without SO_ZEROCOPY support the buffer is copied and done runs once it is sent.
+ * Completion and cancellation otherwise follow mevel_conn_sendfile.
+ *
+ * @param done completion on the loop thread, may be NULL
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_conn_sendzc(mevel_event_t*, const void* buf, size_t len, mevel_sent_fn* done, void* arg);
+
+/**
+ * @brief mevel_conn_close closes the connection once its pending output is sent
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_conn_close(mevel_event_t*);
+
+/**
+ * @brief mevel_conn_full tells producers to back off until the MEVEL_WRITE callback
+ *
+ * @return int 1 while the queued output is above the high watermark
+ */
+int             mevel_conn_full(mevel_event_t*);
+
+/**
+ * @brief mevel_conn_wmk sets the output watermarks of the connection
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_conn_wmk(mevel_event_t*, size_t low, size_t high);
+
+/**
+ * @brief mevel_ini_dgram creates a datagram event; the loop drains the socket with
+ * recvmmsg and calls back once per batch with the number of datagrams received, or
+ * -errno on error. Datagrams longer than a slot are truncated. MEVEL_ERR_AGAIN
+ * stops the drain and leaves the rest for the next iteration.
+ *
+ * @param count slots per batch, 0 for MEVEL_DGRAM_BATCH
+ * @param size bytes per slot, 0 for MEVEL_DGRAM_SIZE
+ * @return mevel_event_t*
+ */
+mevel_event_t*  mevel_ini_dgram(mevel_ctx_t*, mevel_cb_t, int fd, unsigned count, size_t size);
+
+/**
+ * @brief mevel_dgram_data gives the payload of a datagram of the current batch
+ *
+ * @return void* NULL past the batch
+ */
+void*           mevel_dgram_data(mevel_event_t*, unsigned indx, size_t* len);
+
+/**
+ * @brief mevel_dgram_peer gives the sender of a datagram of the current batch
+ *
+ * @return const struct sockaddr* NULL past the batch
+ */
+const struct sockaddr* mevel_dgram_peer(mevel_event_t*, unsigned indx, socklen_t* alen);
+
+/**
+ * @brief mevel_dgram_send queues a copy of a datagram; the queue goes out with one
+ * sendmmsg when it is full, after the callback of the event returns, or on mevel_dgram_flush
+ *
+ * @param addr destination, NULL on connected sockets
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_dgram_send(mevel_event_t*, const void* buf, size_t len, const struct sockaddr* addr, socklen_t alen);
+
+/**
+ * @brief mevel_dgram_send_gso queues a buffer the kernel splits into datagrams of seg
+ * bytes each, the last one possibly shorter (UDP_SEGMENT); buffers larger than a slot
+ * are sent right away after the queue
+ *
+ * @param seg segment size, 0 for a single datagram
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_dgram_send_gso(mevel_event_t*, const void* buf, size_t len, size_t seg,
+                                     const struct sockaddr* addr, socklen_t alen);
+
+/**
+ * @brief mevel_dgram_reply queues a datagram to the sender of a datagram of the current batch
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_dgram_reply(mevel_event_t*, unsigned indx, const void* buf, size_t len);
+
+/**
+ * @brief mevel_dgram_reply_gso replies with segmented buffer, see mevel_dgram_send_gso
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_dgram_reply_gso(mevel_event_t*, unsigned indx, const void* buf, size_t len, size_t seg);
+
+/**
+ * @brief mevel_dgram_gro has the kernel coalesce datagrams of a flow into super-buffers
+ * (UDP_GRO); the receive slots grow to MMSG_MAX bytes. Not from the callback.
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_dgram_gro(mevel_event_t*);
+
+/**
+ * @brief mevel_dgram_seg gives the segment size of a coalesced datagram of the current
+ * batch; its payload is a run of datagrams of that size, the last one possibly shorter
+ *
+ * @return size_t 0 for a single datagram
+ */
+size_t          mevel_dgram_seg(mevel_event_t*, unsigned indx);
+
+/**
+ * @brief mevel_dgram_flush sends the queued datagrams
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_dgram_flush(mevel_event_t*);
+
+/**
+ * @brief mevel_ini_timer creates a timer event; it is armed by mevel_add
  *
  * @return mevel_event_t*
  */
@@ -189,6 +721,69 @@ mevel_event_t*  mevel_ini_sig(mevel_ctx_t*, mevel_cb_t);
  */
 mevel_err_t     mevel_ini_sig_add(mevel_event_t*, int);
 
+/**
+ * @brief mevel_grp_ini creates a group of independent event loops
+ *
+ * @param size number of loops; zero starts one loop per available cpu
+ * @param flags MEVEL_GRP_PIN and/or MEVEL_GRP_CBPF
+ * @return mevel_grp_t*
+ */
+mevel_grp_t*    mevel_grp_ini(size_t size, int flags);
+
+/**
+ * @brief mevel_grp_rel releases the group and every loop context
+ *
+ */
+void            mevel_grp_rel(mevel_grp_t*);
+
+/**
+ * @brief mevel_grp_run runs every loop on its own thread and blocks until all return
+ *
+ * @return mevel_err_t the first error returned by a loop
+ */
+mevel_err_t     mevel_grp_run(mevel_grp_t*);
+
+/**
+ * @brief mevel_grp_stp asks every loop of the group to return
+ *
+ */
+void            mevel_grp_stp(mevel_grp_t*);
+
+/**
+ * @brief mevel_grp_add_tcp adds one SO_REUSEPORT listener per loop on the same address;
+ * with MEVEL_GRP_CBPF the kernel hands each connection to the loop pinned to the cpu
+ * that received it, whatever cpus the affinity mask holds. On failure the listeners
+ * already added are removed again
+ *
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_grp_add_tcp(mevel_grp_t*, mevel_cb_t, int stype, const char* straddr, int port, int evmask);
+
+/**
+ * @brief mevel_exe_ini attaches a work-stealing thread pool to the context;
+ * completions are delivered on the loop through an eventfd event.
+ * Release the executor before the context.
+ *
+ * @param nthreads number of workers; zero starts one per online cpu
+ * @return mevel_exe_t*
+ */
+mevel_exe_t*    mevel_exe_ini(mevel_ctx_t*, size_t nthreads);
+
+/**
+ * @brief mevel_exe_rel stops the workers and drops the tasks not yet run
+ *
+ */
+void            mevel_exe_rel(mevel_exe_t*);
+
+/**
+ * @brief mevel_exe_put runs fn(arg) on a worker, then done(ctx, arg) on the loop thread
+ *
+ * @param fn the work; it must not touch the loop
+ * @param done the completion; may be NULL
+ * @return mevel_err_t
+ */
+mevel_err_t     mevel_exe_put(mevel_exe_t*, mevel_task_fn* fn, mevel_done_fn* done, void* arg);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -203,6 +798,7 @@ enum type_en
 	MEVEL_TYPE_SIGNAL   = 101,
 	MEVEL_TYPE_TIMER    = 102,
 	MEVEL_TYPE_ACC      = 103,
+	MEVEL_TYPE_DGRAM    = 106,
 };
 
 enum error_en
@@ -221,11 +817,215 @@ enum error_en
     MEVEL_ERR_SIGNAL,
     MEVEL_ERR_UDP,
     MEVEL_ERR_TCP,
-    MEVEL_ERR_FIO
+    MEVEL_ERR_FIO,
+    MEVEL_ERR_AGAIN         // not an error; an edge-triggered callback yielded with input left
 };
 
 struct mevent;
-using callback_t = std::function<error_en(const mevent&, int)>;
+
+/**
+ * @brief callback_t is a move-only callable with inline storage; callables larger
+ * than capacity do not compile, so neither storing nor calling one allocates.
+ * bind() wraps a handler by pointer; the handler has to outlive its registrations.
+ * The handler is called through one function pointer instantiated for its type, in
+ * which its operator() is bound statically and can be inlined. The loop keeps events
+ * of every handler type in one table, so a fully static dispatch would need the loop
+ * itself to be templated on the handler types; that indirect call is what remains.
+ */
+class callback_t
+{
+public:
+
+    static constexpr size_t capacity = 48;
+
+    callback_t() noexcept
+    : call(nullptr)
+    , manage(nullptr)
+    {
+    }
+
+    callback_t(std::nullptr_t) noexcept
+    : callback_t()
+    {
+    }
+
+    template <typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, callback_t>::value>::type>
+    callback_t(F&& fn)
+    : call(nullptr)
+    , manage(nullptr)
+    {
+        typedef typename std::decay<F>::type fn_t;
+
+        static_assert(sizeof(fn_t) <= capacity, "callable exceeds the inline storage of callback_t");
+        static_assert(alignof(fn_t) <= alignof(storage_t), "callable is over-aligned for callback_t");
+
+        if (is_null(fn)) return;
+
+        new (&storage) fn_t(std::forward<F>(fn));
+        call    = &invoke<fn_t>;
+        manage  = &manage_fn<fn_t>;
+    }
+
+    callback_t(callback_t&& other) noexcept
+    : call(nullptr)
+    , manage(nullptr)
+    {
+        take(other);
+    }
+
+    callback_t& operator=(callback_t&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    callback_t(const callback_t&) = delete;
+    callback_t& operator=(const callback_t&) = delete;
+
+    ~callback_t()
+    {
+        reset();
+    }
+
+    template <typename H>
+    static callback_t bind(H* handler)
+    {
+        callback_t cb;
+
+        if (handler != nullptr)
+        {
+            new (&cb.storage) H*(handler);
+            cb.call     = &invoke_ptr<H>;
+            cb.manage   = &manage_fn<H*>;
+        }
+        return cb;
+    }
+
+    error_en operator()(const mevent& ev, int flags) const
+    {
+        return call(const_cast<storage_t*>(&storage), ev, flags);
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return call != nullptr;
+    }
+
+    // a copy for callables that can be copied, an empty callback otherwise
+    callback_t clone() const
+    {
+        callback_t cb;
+
+        if (manage && manage(op_copy, &cb.storage, const_cast<storage_t*>(&storage)))
+        {
+            cb.call     = call;
+            cb.manage   = manage;
+        }
+        return cb;
+    }
+
+    bool copyable() const
+    {
+        return manage && manage(op_query, nullptr, nullptr);
+    }
+
+private:
+
+    typedef typename std::aligned_storage<capacity, alignof(std::max_align_t)>::type storage_t;
+
+    enum op_en { op_move, op_copy, op_destroy, op_query };
+
+    storage_t   storage;
+    error_en    (*call)(void*, const mevent&, int);
+    bool        (*manage)(op_en, void*, void*);
+
+    template <typename T>
+    static bool is_null(const T&) { return false; }
+
+    template <typename T>
+    static bool is_null(T* const& ptr) { return ptr == nullptr; }
+
+    template <typename F>
+    static error_en invoke(void* fn, const mevent& ev, int flags)
+    {
+        return (*static_cast<F*>(fn))(ev, flags);
+    }
+
+    template <typename H>
+    static error_en invoke_ptr(void* handler, const mevent& ev, int flags)
+    {
+        return (**static_cast<H**>(handler))(ev, flags);
+    }
+
+    template <typename F>
+    static bool copy_fn(void* dst, void* src, std::true_type)
+    {
+        new (dst) F(*static_cast<const F*>(src));
+        return true;
+    }
+
+    template <typename F>
+    static bool copy_fn(void*, void*, std::false_type)
+    {
+        return false;
+    }
+
+    template <typename F>
+    static bool manage_fn(op_en op, void* dst, void* src)
+    {
+        switch (op)
+        {
+        case op_move:
+            new (dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
+            return true;
+        case op_copy:
+            return copy_fn<F>(dst, src, std::is_copy_constructible<F>());
+        case op_destroy:
+            static_cast<F*>(dst)->~F();
+            return true;
+        case op_query:
+            return std::is_copy_constructible<F>::value;
+        }
+        return false;
+    }
+
+    void take(callback_t& other) noexcept
+    {
+        if (other.manage == nullptr) return;
+
+        other.manage(op_move, &storage, &other.storage);
+        call            = other.call;
+        manage          = other.manage;
+        other.call      = nullptr;
+        other.manage    = nullptr;
+    }
+
+    void reset() noexcept
+    {
+        if (manage) manage(op_destroy, &storage, nullptr);
+        call    = nullptr;
+        manage  = nullptr;
+    }
+};
+
+// receive and reply batches of datagram events
+struct dgram_t
+{
+    mmsg_t          in;
+    mmsg_t          out;        // allocated on first use
+
+    dgram_t();
+    ~dgram_t();
+
+    dgram_t(const dgram_t&) = delete;
+    dgram_t& operator=(const dgram_t&) = delete;
+};
 
 struct mevent
 {
@@ -233,39 +1033,266 @@ struct mevent
     epoll_event     event;
     sigset_t        smask;
     int             evmask;
-    int             fd;
+    int             fd;         // negative timer id for timer events
+    wheel_node_t    tnode;
     callback_t      cb;
+    std::unique_ptr<dgram_t> dgram;
+    bool            ready = false;  // queued for another turn with rflags
+    int             rflags = 0;
+    int             prio = MEVEL_PRIO_NORMAL;   // dispatch class, see mevel::set_prio
+
+    // datagram events get the batch size as flags; these access the current batch
+    void* data(unsigned indx, size_t& len) const;
+    const sockaddr* peer(unsigned indx, socklen_t& alen) const;
+
+    // segment size of a coalesced receive, 0 for a single datagram
+    size_t segment(unsigned indx) const;
+
+    // replies go out with one sendmmsg after the callback, or when the queue is full;
+    // a non-zero seg has the kernel split the buffer into datagrams of seg bytes
+    bool send(const void* buf, size_t len, const sockaddr* addr, socklen_t alen, size_t seg = 0) const;
+    bool reply(unsigned indx, const void* buf, size_t len, size_t seg = 0) const;
+    bool flush() const;
+};
+
+// a task posted from another thread
+struct post_t
+{
+    mpsc_node_t     node;
+
+    post_t()
+    {
+        node.nxt = nullptr;
+        node.ptr = this;
+    }
+
+    virtual ~post_t() {}
+    virtual void run() = 0;
 };
 
+template <typename F>
+struct post_fn : post_t
+{
+    F               fn;
+
+    template <typename G>
+    explicit post_fn(G&& g)
+    : fn(std::forward<G>(g))
+    {
+    }
+
+    void run() override
+    {
+        fn();
+    }
+};
+
+// identifies a phase hook of a loop, 0 is never used
+typedef size_t hookid_t;
+
 class mevel
 {
 private:
 
+    typedef std::vector<std::unique_ptr<mevent>> table_t;
+
+    struct hook_t
+    {
+        hookid_t                id;         // 0 once deleted during a walk
+        std::unique_ptr<post_t> fn;
+    };
+
     int                                 epollfd;
+    int                                 hifd;       // epoll set of MEVEL_PRIO_HIGH events, see enable_prio
+    bool                                prios;      // batches can mix classes and are ordered before dispatch
     char                                running;
-    std::unordered_map <int, mevent>    eventmap;
+    char                                stopping;   // set by stop; run returns at once afterwards
+    table_t                             fdmap;      // indexed by fd; epoll data.ptr points into it
+    table_t                             timers;     // indexed by -fd - 1
+    std::vector<int>                    timerids;   // released timer slots
+    table_t                             retired;    // deleted while dispatching, released per iteration
+    std::vector<int>                    ready;      // edge-triggered fds that yielded with input left
+    std::vector<int>                    turn;       // the still-ready fds of the current pass
     error_en                            error_flag;
     mevent                              ev_signal;
+    wheel_ctx_t*                        wheel;
+    mevel_batch_t                       batch;
+    int                                 backlog;    // listen backlog of add_tcp
+    int                                 accepts;    // accepts per listener per iteration
+    mevel_stats_t                       stats;
+    mpsc_t                              posts;      // tasks posted by other threads
+    int                                 postfd;     // eventfd waking the loop for posts and stops
+    mpsc_t                              defers;     // tasks run once after the current batch
+    std::vector<hook_t>                 hooks[MEVEL_PHASES];
+    hookid_t                            hookids;    // last hook id handed out
+    size_t                              idle;       // idle hooks; the loop only polls while there are any
+    bool                                hooking;    // walking the hooks; deleted ones are swept afterwards
+    bool                                dead;       // hooks deleted during the walk
+    std::unique_ptr<mevel_metrics_t>    metrics;    // see enable_metrics
+    std::unique_ptr<trace_t>            trace;      // see enable_trace
 
-    bool add(mevent ev);
-    bool del(mevent& ev);
+    mevent* find(int fd) const;
+    bool add(mevent&& ev);
+    bool del(const mevent& ev);
+    void run_accept(const mevent& lst);
+    error_en run_dgram(mevent& ev);
+    error_en run_event(mevent& ev, int flags);
+    int epfd(const mevent& ev) const;
+    void run_batch(const epoll_event* events, int nfds, uint64_t& stamp, bool timed);
+    void run_ready(uint64_t& stamp, bool timed);
+    void run_timers();
+    void metric(hist_t* hist, uint64_t val);
+    void metric(uint64_t* sum, uint64_t val);
+    void record(int type, int fd, int flags, int err, uint64_t start, uint64_t end);
+    void run_posts();
+    void run_list(mpsc_node_t* node);
+    void run_hooks(int phase);
+    bool push(post_t* post);
+    bool push_defer(post_t* post);
+    hookid_t push_hook(int phase, post_t* post);
 
 public:
 
-    mevel();
+    /**
+     * @param nevents initial and minimum epoll batch size
+     * @param maxevents largest adaptive epoll batch size
+     * @param backlog listen backlog of add_tcp listeners
+     * @param accepts accepts per listener per iteration
+     */
+    explicit mevel(int nevents = MEVEL_MAX_EVENTS, int maxevents = MEVEL_MAX_BATCH,
+                   int backlog = SOMAXCONN, int accepts = MEVEL_MAX_ACCEPTS);
     ~mevel();
 
     bool add_timer(callback_t cb, int timeout, int period);
+    template <typename H>
+    bool add_timer(H* handler, int timeout, int period)
+    {
+        return add_timer(callback_t::bind(handler), timeout, period);
+    }
+
+    bool set_timer(const mevent& ev, int timeout, int period);
+    bool clear_timer(const mevent& ev);
     bool add_fio(callback_t cb, int fd, int evmask);
+
+    // removes the event of fd without closing it; safe from within its callback
+    bool del_fio(int fd);
+
     bool add_tcp(callback_t cb, int stype, const char* straddr, int port, int evmask);
     bool add_udp(callback_t cb, int stype, const char* straddr, int port, int evmask);
+
+    /**
+     * @brief add_udp_dgram binds a datagram socket that is drained with recvmmsg;
+     * see mevel_ini_dgram for the callback arguments
+     *
+     * @param count slots per batch, 0 for MEVEL_DGRAM_BATCH
+     * @param size bytes per slot, 0 for MEVEL_DGRAM_SIZE
+     * @param gro receive coalesced super-buffers, see mevel_dgram_gro
+     */
+    bool add_udp_dgram(callback_t cb, int stype, const char* straddr, int port, unsigned count = 0, size_t size = 0, bool gro = false);
+
     bool add_signal(callback_t cb, int sig);
     bool add_signal(callback_t cb, std::initializer_list<int> signums);
 
+    // handler objects are called through a pointer and must outlive their events
+    template <typename H>
+    bool add_fio(H* handler, int fd, int evmask)
+    {
+        return add_fio(callback_t::bind(handler), fd, evmask);
+    }
+
+    template <typename H>
+    bool add_tcp(H* handler, int stype, const char* straddr, int port, int evmask)
+    {
+        return add_tcp(callback_t::bind(handler), stype, straddr, port, evmask);
+    }
+
+    template <typename H>
+    bool add_udp(H* handler, int stype, const char* straddr, int port, int evmask)
+    {
+        return add_udp(callback_t::bind(handler), stype, straddr, port, evmask);
+    }
+
+    template <typename H>
+    bool add_udp_dgram(H* handler, int stype, const char* straddr, int port, unsigned count = 0, size_t size = 0, bool gro = false)
+    {
+        return add_udp_dgram(callback_t::bind(handler), stype, straddr, port, count, size, gro);
+    }
+
+    template <typename H>
+    bool add_signal(H* handler, std::initializer_list<int> signums)
+    {
+        return add_signal(callback_t::bind(handler), signums);
+    }
+
     void clear_error_flag();
     error_en get_error_flag();
+    mevel_stats_t get_stats() const;
+
+    /**
+     * @brief enable_metrics starts recording the histograms of mevel_metrics_t;
+     * get_metrics copies them and is safe from any thread, see mevel_get_metrics
+     */
+    bool enable_metrics();
+    bool get_metrics(mevel_metrics_t& snap) const;
+
+    /**
+     * @brief enable_trace starts recording every callback and wait in a ring of
+     * size records; timers appear with their negative id as fd. get_trace and
+     * dump_trace are safe from any thread, see mevel_get_trace and mevel_dump_trace
+     */
+    bool enable_trace(size_t size = MEVEL_TRACE_SIZE);
+    size_t get_trace(trace_rec_t* out, size_t max) const;
+    bool dump_trace(int fd) const;
+
+    /**
+     * @brief set_prio sets the dispatch class of the event on fd; batches are
+     * dispatched by class, see mevel_set_prio. enable_prio moves the high class
+     * to its own epoll set, polled ahead of every batch.
+     */
+    bool set_prio(int fd, int prio);
+    bool enable_prio();
 
     bool run();
+
+    // safe from any thread; wakes the loop instead of waiting for its timeout.
+    // A stop is final, even when it comes before run
+    void stop();
+
+    /**
+     * @brief post runs fn() on the loop thread; safe from any thread. A burst of
+     * posts costs one eventfd write and runs in posting order. Posts still pending
+     * when the loop is destroyed are dropped.
+     */
+    template <typename F>
+    bool post(F&& fn)
+    {
+        return push(new post_fn<typename std::decay<F>::type>(std::forward<F>(fn)));
+    }
+
+    /**
+     * @brief defer runs fn() once after the events and timers of the current
+     * iteration are dispatched; see mevel_defer
+     */
+    template <typename F>
+    bool defer(F&& fn)
+    {
+        return push_defer(new post_fn<typename std::decay<F>::type>(std::forward<F>(fn)));
+    }
+
+    /**
+     * @brief add_hook calls fn() in every iteration at a MEVEL_PHASE_* phase
+     * until the hook is deleted; see mevel_add_hook
+     *
+     * @return the id of the hook, 0 on failure
+     */
+    template <typename F>
+    hookid_t add_hook(int phase, F&& fn)
+    {
+        return push_hook(phase, new post_fn<typename std::decay<F>::type>(std::forward<F>(fn)));
+    }
+
+    // safe from within the hooks themselves
+    bool del_hook(hookid_t id);
 };
 
 class exception : public std::exception
@@ -0,0 +1,94 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __MMSG_H__
+#define __MMSG_H__
+
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// batch of datagram slots for recvmmsg and sendmmsg; every slot owns a
+// buffer of the same size, room for a peer address and a control message
+// carrying the UDP segment size of GRO receives and GSO sends.
+
+#define MMSG_MAX    65535   // largest UDP payload, so also the largest coalesced receive
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    struct mmsghdr*             msgs;
+    struct iovec*               iovs;
+    struct sockaddr_storage*    addrs;
+    char*                       bufs;
+    char*                       ctls;       // control messages
+    unsigned short*             segs;       // segment sizes, 0 for plain datagrams
+    unsigned                    count;      // slots
+    unsigned                    len;        // slots filled
+    size_t                      size;       // bytes per slot
+} mmsg_t;
+
+int             mmsg_ini(mmsg_t*, unsigned count, size_t size);
+void            mmsg_rel(mmsg_t*);
+
+/**
+ * receives up to count datagrams without blocking; returns their number or -1
+ */
+int             mmsg_rcv(mmsg_t*, int fd);
+
+/**
+ * queues a copy of the datagram; fails when it is larger than a slot or the batch is full.
+ * A non-zero seg has the kernel split it into datagrams of seg bytes (UDP_SEGMENT).
+ */
+int             mmsg_put(mmsg_t*, const void*, size_t, const struct sockaddr*, socklen_t, unsigned short seg);
+
+/**
+ * queues a datagram for fd as mmsg_put does, sending the batch first when it is full;
+ * a datagram larger than a slot is sent on its own after the queued ones
+ */
+int             mmsg_out(mmsg_t*, int fd, const void*, size_t, const struct sockaddr*, socklen_t, unsigned short seg);
+
+/**
+ * sends one datagram right away, split into seg bytes each when seg is non-zero
+ */
+int             mmsg_snd_one(int fd, const void*, size_t, const struct sockaddr*, socklen_t, unsigned short seg);
+
+/**
+ * sends the queued datagrams and empties the batch; what the socket refuses is dropped
+ * and reported by -1, otherwise the number sent is returned
+ */
+int             mmsg_snd(mmsg_t*, int fd);
+
+void*           mmsg_buf(const mmsg_t*, unsigned indx, size_t* len);
+const struct sockaddr* mmsg_addr(const mmsg_t*, unsigned indx, socklen_t* alen);
+
+/**
+ * enables UDP_GRO on fd and grows the slots to MMSG_MAX; only while the batch is empty
+ */
+int             mmsg_gro(mmsg_t*, int fd);
+
+/**
+ * segment size of a coalesced receive (UDP_GRO), 0 for a single datagram
+ */
+unsigned short  mmsg_seg(const mmsg_t*, unsigned indx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __MMSG_H__
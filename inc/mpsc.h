@@ -0,0 +1,55 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __MPSC_H__
+#define __MPSC_H__
+
+#include <stddef.h>
+
+// lock-free multi-producer single-consumer list of intrusive nodes; producers
+// push with a compare-and-swap, the consumer takes everything at once.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mpsc_node_s {
+    struct mpsc_node_s*     nxt;
+    void*                   ptr;
+} mpsc_node_t;
+
+typedef struct {
+    mpsc_node_t*            head;       // most recent push
+} mpsc_t;
+
+void            mpsc_ini(mpsc_t*);
+
+/**
+ * pushes a node from any thread; returns 1 if the list was empty, which is
+ * when the consumer has to be woken up
+ */
+int             mpsc_put(mpsc_t*, mpsc_node_t*);
+
+/**
+ * takes every node pushed so far, oldest first
+ */
+mpsc_node_t*    mpsc_get(mpsc_t*);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __MPSC_H__
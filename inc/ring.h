@@ -0,0 +1,60 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+// byte ring buffer with a power of two capacity; the free and the filled
+// part are exposed as at most two iovecs for readv and writev.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    char*       buf;
+    size_t      cap;
+    size_t      head;       // read position, wraps with the size_t range
+    size_t      tail;       // write position
+} ring_t;
+
+int             ring_ini(ring_t*, size_t cap);
+void            ring_rel(ring_t*);
+
+size_t          ring_len(const ring_t*);
+size_t          ring_spc(const ring_t*);
+
+/**
+ * grows the ring until len more bytes fit; max bounds the capacity, 0 for no bound
+ */
+int             ring_res(ring_t*, size_t len, size_t max);
+
+size_t          ring_put(ring_t*, const void*, size_t);
+size_t          ring_get(ring_t*, void*, size_t);
+
+int             ring_iov_rd(const ring_t*, struct iovec iov[2]);
+int             ring_iov_wr(const ring_t*, struct iovec iov[2]);
+void            ring_adv_rd(ring_t*, size_t);
+void            ring_adv_wr(ring_t*, size_t);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __RING_H__
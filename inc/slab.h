@@ -0,0 +1,77 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stddef.h>
+
+// fixed-size object pool; objects are carved from chunks and recycled through
+// a free list, and come from the heap when no chunk can be allocated. Every
+// object carries a header naming its pool, so slab_put takes any of them, and
+// a tag that tells them apart from memory allocated elsewhere.
+
+#define SLAB_TAG        0x51AB0B1Eu
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef union slab_hdr_u {
+    struct {
+        union {
+            struct slab_ctx_s*  slab;   // owning pool while in use, NULL for heap objects
+            union slab_hdr_u*   nxt;    // next free object while on the free list
+        };
+        unsigned            tag;        // SLAB_TAG while in use
+    } h;
+    max_align_t         align;
+} slab_hdr_t;
+
+typedef struct slab_ctx_s {
+    size_t          size;           // object size including its header
+    size_t          chunk;          // objects per chunk, 0 to always use the heap
+    slab_hdr_t*     free;
+    slab_hdr_t*     chunks;         // the first header of a chunk links the chunks
+    size_t          count;          // objects carved from chunks
+    size_t          used;           // objects of the chunks handed out
+} slab_ctx_t;
+
+/**
+ * count objects are carved up front; later chunks hold chunk objects each
+ */
+slab_ctx_t*     slab_ini(size_t size, size_t count, size_t chunk);
+void            slab_rel(slab_ctx_t*);
+
+void*           slab_get(slab_ctx_t*);
+void*           slab_heap(size_t size);
+
+/**
+ * returns -1 and leaves the object alone unless slab_get or slab_heap handed it out
+ */
+int             slab_put(void*);
+
+/**
+ * 1 while the object is handed out by slab_get or slab_heap; reads the header in
+ * front of it, so the memory before a foreign object has to be readable
+ */
+int             slab_own(const void*);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __SLAB_H__
@@ -0,0 +1,83 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// flight recorder of fixed-size records; a writer claims the next slot of a
+// power of two ring and overwrites the oldest record once the ring is full.
+// Every record carries its position, so readers skip the ones being rewritten.
+
+#define TRACE_MAGIC     0x4543415254564d45ULL   // "MEVTRACE" in memory on little-endian hosts
+#define TRACE_WAIT      0                       // type of the time blocked in the kernel
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint64_t        seq;        // position + 1 once written, 0 while being written
+    uint64_t        start;      // ns, CLOCK_MONOTONIC
+    uint64_t        end;
+    int32_t         fd;         // negative for timers, -1 for waits
+    uint32_t        flags;      // epoll flags, expirations, completion result or wait timeout
+    uint32_t        tid;        // thread that ran the callback
+    uint16_t        type;       // MEVEL_TYPE_* or TRACE_WAIT
+    int16_t         err;        // result of the callback, mevel_err_t or mevel::error_en
+} trace_rec_t;
+
+typedef struct {
+    trace_rec_t*    recs;
+    size_t          cap;
+    uint64_t        head;       // records ever written
+} trace_t;
+
+// what trace_dump writes ahead of the records
+typedef struct {
+    uint64_t        magic;
+    uint32_t        size;       // sizeof(trace_rec_t)
+    uint32_t        pid;
+    uint64_t        count;      // records that follow
+} trace_hdr_t;
+
+int             trace_ini(trace_t*, size_t cap);
+void            trace_rel(trace_t*);
+
+/**
+ * appends a copy of the record; trace_add assumes a single writer, trace_add_mt any number.
+ * Either may run while another thread reads with trace_get or trace_dump.
+ */
+void            trace_add(trace_t*, const trace_rec_t*);
+void            trace_add_mt(trace_t*, const trace_rec_t*);
+
+/**
+ * copies up to max of the newest complete records, oldest first; returns their number
+ */
+size_t          trace_get(const trace_t*, trace_rec_t* out, size_t max);
+
+/**
+ * writes a trace_hdr_t and the records of trace_get to fd; 0 on success, -1 on error
+ */
+int             trace_dump(const trace_t*, int fd);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __TRACE_H__
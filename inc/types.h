@@ -19,8 +19,23 @@
 
 #include <sys/epoll.h>
 
-#define MEVEL_MAX_EVENTS    10
+#define MEVEL_MAX_EVENTS    10      // initial epoll batch size
+#define MEVEL_MAX_BATCH     1024    // default upper bound of the adaptive epoll batch
 #define MEVEL_MAX_TIMEOUT   2000
+#define MEVEL_MAX_ACCEPTS   64      // accepts per listener per loop iteration
+#define MEVEL_RCV_SIZE      4096    // receive buffer of MEVEL_TYPE_RCV events
+#define MEVEL_URING_ENTRIES 256
+#define MEVEL_URING_BUFS    256     // provided receive buffers of the io_uring backend
+#define MEVEL_SLAB_CHUNK    64      // events per slab chunk once the preallocation is used up
+#define MEVEL_CONN_SIZE     16384   // initial ring size of buffered connections
+#define MEVEL_CONN_MAX      (16 << 20)  // largest input ring of a buffered connection
+#define MEVEL_CONN_LOW      16384   // default low watermark of the output ring
+#define MEVEL_CONN_HIGH     262144  // default high watermark of the output ring
+#define MEVEL_DGRAM_BATCH   64      // datagrams per recvmmsg and sendmmsg
+#define MEVEL_DGRAM_SIZE    2048    // default slot size of datagram batches
+#define MEVEL_DGRAM_ROUNDS  4       // full batches received per readiness before yielding
+#define MEVEL_READ_BUDGET   65536   // bytes a buffered connection reads per turn before yielding
+#define MEVEL_TRACE_SIZE    65536   // default records of the trace ring
 
 #define MEVEL_NONE          0
 #define MEVEL_ERROR         EPOLLERR
@@ -32,6 +47,26 @@
 #define MEVEL_EDGE          EPOLLET
 #define MEVEL_ONESHOT       EPOLLONESHOT
 
+#define MEVEL_CTX_MT        0x01    // mevel_run may be called from several threads
+#define MEVEL_CTX_URING     0x02    // io_uring backend instead of epoll
+#define MEVEL_CTX_NOSLAB    0x04    // allocate events from the heap
+#define MEVEL_CTX_METRICS   0x08    // record latency histograms, see mevel_get_metrics
+#define MEVEL_CTX_TRACE     0x10    // record every callback in a trace ring, see mevel_dump_trace
+#define MEVEL_CTX_PRIO      0x20    // MEVEL_PRIO_HIGH events get their own epoll set, polled first
+
+#define MEVEL_PRIO_HIGH     0       // control-plane events; dispatched first in a batch
+#define MEVEL_PRIO_NORMAL   1       // the class of every new event
+#define MEVEL_PRIO_LOW      2       // bulk data; dispatched last in a batch
+#define MEVEL_PRIOS         3
+
+#define MEVEL_PHASE_PREP    0       // before the loop waits for events
+#define MEVEL_PHASE_CHECK   1       // after every dispatched batch
+#define MEVEL_PHASE_IDLE    2       // after a wait that returned no events
+#define MEVEL_PHASES        3
+
+#define MEVEL_GRP_PIN       0x01    // pin every loop of a group to its own cpu
+#define MEVEL_GRP_CBPF      0x02    // steer connections to the loop of the receiving cpu
+
 #define MEVEL_IPV6          AF_INET6
 #define MEVEL_IPV4          AF_INET
 #define MEVEL_UNIX          AF_UNIX
@@ -47,8 +82,13 @@ typedef enum {
 	MEVEL_TYPE_SIGNAL   = 101,
 	MEVEL_TYPE_TIMER    = 102,
 	MEVEL_TYPE_ACC      = 103,
+	MEVEL_TYPE_RCV      = 104,
+	MEVEL_TYPE_CONN     = 105,
+	MEVEL_TYPE_DGRAM    = 106,
 } mevel_type_t;
 
+#define MEVEL_TYPES         7       // event types, from MEVEL_TYPE_IO on
+
 typedef enum {
     MEVEL_ERR_NONE,
     MEVEL_ERR_NULL,
@@ -62,7 +102,9 @@ typedef enum {
     MEVEL_ERR_SIGNAL,
     MEVEL_ERR_UDP,
     MEVEL_ERR_TCP,
-    MEVEL_ERR_FIO
+    MEVEL_ERR_FIO,
+    MEVEL_ERR_EXEC,
+    MEVEL_ERR_AGAIN         // not an error; the callback yielded with input left, see mevel_ini_fio
 } mevel_err_t;
 
 #ifdef __cplusplus
@@ -0,0 +1,49 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// minimal io_uring wrapper on top of the raw system calls
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+typedef struct uring_ctx uring_ctx_t;
+
+uring_ctx_t*            uring_ini(unsigned entries);
+void                    uring_rel(uring_ctx_t*);
+
+struct io_uring_sqe*    uring_sqe(uring_ctx_t*);
+int                     uring_sub(uring_ctx_t*, unsigned wait, int timeout);
+
+struct io_uring_cqe*    uring_cqe(uring_ctx_t*);
+void                    uring_cqe_del(uring_ctx_t*);
+
+int                     uring_buf_ini(uring_ctx_t*, unsigned count, unsigned size, unsigned short bgid);
+void*                   uring_buf(uring_ctx_t*, unsigned short bid);
+void                    uring_buf_put(uring_ctx_t*, unsigned short bid);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __URING_H__
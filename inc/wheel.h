@@ -0,0 +1,69 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __WHEEL_H__
+#define __WHEEL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// hierarchical timer wheel with 1 ms ticks; WHEEL_LEVELS levels of
+// WHEEL_SLOTS slots cover 2^(WHEEL_BITS * WHEEL_LEVELS) ms (~4.6 hours),
+// longer timeouts are parked in the last level and cascaded again.
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct wheel_node_s {
+    void*                   ptr;
+    struct wheel_node_s*    nxt;
+    struct wheel_node_s*    prv;
+    uint64_t                expire;     // absolute deadline in ms
+    uint64_t                period;     // repeat interval in ms, 0 for one-shot
+} wheel_node_t;
+
+typedef struct {
+    uint64_t        clk;                // last processed tick
+    uint64_t        bitmap[WHEEL_LEVELS];
+    wheel_node_t    slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    wheel_node_t    due;                // expired and not yet popped
+    size_t          size;
+} wheel_ctx_t;
+
+uint64_t        wheel_clk();
+
+wheel_ctx_t*    wheel_ini(uint64_t now);
+void            wheel_rel(wheel_ctx_t*);
+
+void            wheel_node_ini(wheel_node_t*, void*);
+int             wheel_node_linked(const wheel_node_t*);
+
+void            wheel_add(wheel_ctx_t*, wheel_node_t*, uint64_t expire);
+void            wheel_del(wheel_ctx_t*, wheel_node_t*);
+
+wheel_node_t*   wheel_pop(wheel_ctx_t*, uint64_t now);
+int             wheel_nxt(wheel_ctx_t*, uint64_t now);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __WHEEL_H__
@@ -0,0 +1,405 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <sys/eventfd.h>
+
+#include "mevel.h"
+
+#define MEVEL_DEQ_SIZE  64
+
+typedef struct mevel_task {
+    struct mevel_task*  nxt;
+    mevel_task_fn*      fn;
+    mevel_done_fn*      done;
+    void*               arg;
+} mevel_task_t;
+
+// a worker owns the tail of its deque; thieves take from the head
+typedef struct {
+    pthread_mutex_t     lock;
+    mevel_task_t**      ring;
+    size_t              cap;
+    size_t              head;
+    size_t              size;
+} mevel_deq_t;
+
+typedef struct {
+    mevel_exe_t*        exe;
+    pthread_t           thread;
+    size_t              indx;
+    mevel_deq_t         deq;
+} mevel_wrk_t;
+
+struct mevel_exe {
+    mevel_ctx_t*        ctx;
+    mevel_event_t*      ev;         // completion eventfd on the loop
+    size_t              size;       // number of deques
+    size_t              nthr;       // number of running workers
+    mevel_wrk_t*        wrks;
+    size_t              next;       // round-robin target of the loop thread
+    pthread_mutex_t     lock;       // guards pending and stop for sleeping workers
+    pthread_cond_t      cond;
+    size_t              pending;
+    int                 stop;
+    pthread_mutex_t     dlock;      // guards the completion list
+    mevel_task_t*       done;
+};
+
+static __thread mevel_wrk_t* mevel_wrk_self = NULL;
+
+static int mevel_deq_ini(mevel_deq_t* deq)
+{
+    deq->ring = (mevel_task_t**) malloc(MEVEL_DEQ_SIZE * sizeof(mevel_task_t*));
+    deq->cap  = MEVEL_DEQ_SIZE;
+    deq->head = 0;
+    deq->size = 0;
+
+    if (deq->ring == NULL) return -1;
+
+    pthread_mutex_init(&deq->lock, NULL);
+    return 0;
+}
+
+static void mevel_deq_rel(mevel_deq_t* deq)
+{
+    for (size_t i = 0; i < deq->size; i++)
+    {
+        free(deq->ring[(deq->head + i) % deq->cap]);
+    }
+
+    free(deq->ring);
+    pthread_mutex_destroy(&deq->lock);
+}
+
+static int mevel_deq_put(mevel_deq_t* deq, mevel_task_t* task)
+{
+    pthread_mutex_lock(&deq->lock);
+
+    if (deq->size == deq->cap)
+    {
+        mevel_task_t** ring = (mevel_task_t**) malloc(2 * deq->cap * sizeof(mevel_task_t*));
+
+        if (ring == NULL)
+        {
+            pthread_mutex_unlock(&deq->lock);
+            return -1;
+        }
+
+        for (size_t i = 0; i < deq->size; i++)
+        {
+            ring[i] = deq->ring[(deq->head + i) % deq->cap];
+        }
+
+        free(deq->ring);
+        deq->ring = ring;
+        deq->cap *= 2;
+        deq->head = 0;
+    }
+
+    deq->ring[(deq->head + deq->size) % deq->cap] = task;
+    deq->size++;
+
+    pthread_mutex_unlock(&deq->lock);
+    return 0;
+}
+
+static mevel_task_t* mevel_deq_pop_tail(mevel_deq_t* deq)
+{
+    mevel_task_t* task = NULL;
+
+    pthread_mutex_lock(&deq->lock);
+    if (deq->size)
+    {
+        deq->size--;
+        task = deq->ring[(deq->head + deq->size) % deq->cap];
+    }
+    pthread_mutex_unlock(&deq->lock);
+
+    return task;
+}
+
+static mevel_task_t* mevel_deq_pop_head(mevel_deq_t* deq)
+{
+    mevel_task_t* task = NULL;
+
+    // thieves do not queue up behind a busy deque
+    if (pthread_mutex_trylock(&deq->lock) != 0) return NULL;
+
+    if (deq->size)
+    {
+        task = deq->ring[deq->head];
+        deq->head = (deq->head + 1) % deq->cap;
+        deq->size--;
+    }
+    pthread_mutex_unlock(&deq->lock);
+
+    return task;
+}
+
+static mevel_task_t* mevel_exe_get(mevel_wrk_t* wrk)
+{
+    mevel_exe_t*    exe     = wrk->exe;
+    mevel_task_t*   task    = mevel_deq_pop_tail(&wrk->deq);
+
+    for (size_t i = 1; task == NULL && i < exe->size; i++)
+    {
+        task = mevel_deq_pop_head(&exe->wrks[(wrk->indx + i) % exe->size].deq);
+    }
+
+    return task;
+}
+
+static void mevel_exe_fin(mevel_exe_t* exe, mevel_task_t* task)
+{
+    if (task->done == NULL)
+    {
+        free(task);
+        return;
+    }
+
+    pthread_mutex_lock(&exe->dlock);
+    int wake    = (exe->done == NULL);
+    task->nxt   = exe->done;
+    exe->done   = task;
+    pthread_mutex_unlock(&exe->dlock);
+
+    // one write per batch; the loop drains everything queued meanwhile
+    if (wake)
+    {
+        uint64_t one = 1;
+        if (write(exe->ev->fd, &one, sizeof(uint64_t)) < 0) { /* counter saturated; already readable */ }
+    }
+}
+
+static void* mevel_exe_thr(void* arg)
+{
+    mevel_wrk_t*    wrk = (mevel_wrk_t*) arg;
+    mevel_exe_t*    exe = wrk->exe;
+    mevel_task_t*   task;
+
+    mevel_wrk_self = wrk;
+
+    for (;;)
+    {
+        if ((task = mevel_exe_get(wrk)) != NULL)
+        {
+            __atomic_sub_fetch(&exe->pending, 1, __ATOMIC_ACQ_REL);
+            task->fn(task->arg);
+            mevel_exe_fin(exe, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&exe->lock);
+        while (__atomic_load_n(&exe->pending, __ATOMIC_ACQUIRE) == 0 && !exe->stop)
+        {
+            pthread_cond_wait(&exe->cond, &exe->lock);
+        }
+        int stop = exe->stop;
+        pthread_mutex_unlock(&exe->lock);
+
+        if (stop) break;
+    }
+
+    return NULL;
+}
+
+static mevel_err_t mevel_exe_cb(mevel_event_t* ev, int flags)
+{
+    mevel_exe_t*    exe     = (mevel_exe_t*) ev->data;
+    mevel_task_t*   list    = NULL;
+    mevel_task_t*   task    = NULL;
+    uint64_t        count;
+
+    // reset the counter before taking the list so no completion is missed
+    if (read(ev->fd, &count, sizeof(uint64_t)) < 0) { /* spurious wakeup */ }
+
+    pthread_mutex_lock(&exe->dlock);
+    task        = exe->done;
+    exe->done   = NULL;
+    pthread_mutex_unlock(&exe->dlock);
+
+    // the list is LIFO; reverse it to deliver completions in order
+    while (task)
+    {
+        mevel_task_t* nxt = task->nxt;
+        task->nxt = list;
+        list = task;
+        task = nxt;
+    }
+
+    while (list)
+    {
+        task = list;
+        list = list->nxt;
+        task->done(exe->ctx, task->arg);
+        free(task);
+    }
+
+    return MEVEL_ERR_NONE;
+}
+
+mevel_exe_t*  mevel_exe_ini(mevel_ctx_t* ctx, size_t nthreads)
+{
+    if (ctx == NULL) return NULL;
+
+    if (nthreads == 0)
+    {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads  = (ncpu > 0) ? (size_t) ncpu : 1;
+    }
+
+    mevel_exe_t* exe = (mevel_exe_t*) calloc(1, sizeof(mevel_exe_t));
+
+    if (exe == NULL) return NULL;
+
+    exe->ctx    = ctx;
+    exe->wrks   = (mevel_wrk_t*) calloc(nthreads, sizeof(mevel_wrk_t));
+
+    int efd     = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (exe->wrks == NULL || efd < 0)
+    {
+        if (efd >= 0) close(efd);
+        free(exe->wrks);
+        free(exe);
+        return NULL;
+    }
+
+    pthread_mutex_init(&exe->lock, NULL);
+    pthread_mutex_init(&exe->dlock, NULL);
+    pthread_cond_init(&exe->cond, NULL);
+
+    exe->ev = mevel_ini_fio(ctx, mevel_exe_cb, efd, MEVEL_READ);
+
+    if (exe->ev == NULL)
+    {
+        close(efd);
+        mevel_exe_rel(exe);
+        return NULL;
+    }
+
+    exe->ev->data = exe;
+
+    if (mevel_add(ctx, exe->ev) != MEVEL_ERR_NONE)
+    {
+        close(efd);
+        mevel_rel_ev(exe->ev);
+        exe->ev = NULL;
+        mevel_exe_rel(exe);
+        return NULL;
+    }
+
+    // every deque exists before the first worker starts stealing
+    for (; exe->size < nthreads; exe->size++)
+    {
+        mevel_wrk_t* wrk = &exe->wrks[exe->size];
+        wrk->exe  = exe;
+        wrk->indx = exe->size;
+
+        if (mevel_deq_ini(&wrk->deq) < 0) break;
+    }
+
+    for (; exe->nthr < exe->size; exe->nthr++)
+    {
+        mevel_wrk_t* wrk = &exe->wrks[exe->nthr];
+        if (pthread_create(&wrk->thread, NULL, mevel_exe_thr, wrk) != 0) break;
+    }
+
+    if (exe->nthr == 0)
+    {
+        mevel_exe_rel(exe);
+        return NULL;
+    }
+
+    return exe;
+}
+
+void  mevel_exe_rel(mevel_exe_t* exe)
+{
+    if (exe == NULL) return;
+
+    pthread_mutex_lock(&exe->lock);
+    exe->stop = 1;
+    pthread_cond_broadcast(&exe->cond);
+    pthread_mutex_unlock(&exe->lock);
+
+    for (size_t i = 0; i < exe->nthr; i++)
+    {
+        pthread_join(exe->wrks[i].thread, NULL);
+    }
+
+    for (size_t i = 0; i < exe->size; i++)
+    {
+        mevel_deq_rel(&exe->wrks[i].deq);
+    }
+
+    while (exe->done)
+    {
+        mevel_task_t* task = exe->done;
+        exe->done = task->nxt;
+        free(task);
+    }
+
+    if (exe->ev) mevel_del(exe->ctx, exe->ev);
+
+    pthread_cond_destroy(&exe->cond);
+    pthread_mutex_destroy(&exe->dlock);
+    pthread_mutex_destroy(&exe->lock);
+
+    free(exe->wrks);
+    free(exe);
+}
+
+mevel_err_t  mevel_exe_put(mevel_exe_t* exe, mevel_task_fn* fn, mevel_done_fn* done, void* arg)
+{
+    if (exe == NULL || fn == NULL) return MEVEL_ERR_NULL;
+
+    mevel_task_t* task = (mevel_task_t*) malloc(sizeof(mevel_task_t));
+
+    if (task == NULL) return MEVEL_ERR_EXEC;
+
+    task->nxt   = NULL;
+    task->fn    = fn;
+    task->done  = done;
+    task->arg   = arg;
+
+    // a worker keeps what it spawns; the loop spreads its tasks round-robin
+    mevel_wrk_t* wrk = mevel_wrk_self;
+
+    if (wrk == NULL || wrk->exe != exe)
+    {
+        size_t indx = __atomic_fetch_add(&exe->next, 1, __ATOMIC_RELAXED);
+        wrk = &exe->wrks[indx % exe->size];
+    }
+
+    if (mevel_deq_put(&wrk->deq, task) < 0)
+    {
+        free(task);
+        return MEVEL_ERR_EXEC;
+    }
+
+    pthread_mutex_lock(&exe->lock);
+    __atomic_add_fetch(&exe->pending, 1, __ATOMIC_ACQ_REL);
+    pthread_cond_signal(&exe->cond);
+    pthread_mutex_unlock(&exe->lock);
+
+    return MEVEL_ERR_NONE;
+}
@@ -0,0 +1,109 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <string.h>
+
+#include "hist.h"
+
+void hist_ini(hist_t* hist)
+{
+    memset(hist, 0x00, sizeof(hist_t));
+}
+
+int hist_idx(uint64_t val)
+{
+    if (val < HIST_SUB) return (int) val;
+
+    int exp = 63 - __builtin_clzll(val);
+
+    return (exp - HIST_BITS + 1) * HIST_SUB + (int)((val >> (exp - HIST_BITS)) & (HIST_SUB - 1));
+}
+
+uint64_t hist_low(int idx)
+{
+    int group   = idx / HIST_SUB;
+    int sub     = idx % HIST_SUB;
+
+    if (group == 0) return (uint64_t) sub;
+
+    return (uint64_t)(HIST_SUB + sub) << (group - 1);
+}
+
+uint64_t hist_high(int idx)
+{
+    return (idx + 1 < HIST_BUCKETS) ? hist_low(idx + 1) - 1 : UINT64_MAX;
+}
+
+// relaxed loads and stores compile to plain moves; only the readers need them
+void hist_add(hist_t* hist, uint64_t val)
+{
+    uint64_t* bucket = &hist->buckets[hist_idx(val)];
+
+    __atomic_store_n(bucket, __atomic_load_n(bucket, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->count, __atomic_load_n(&hist->count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->sum, __atomic_load_n(&hist->sum, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+
+    if (val > __atomic_load_n(&hist->max, __ATOMIC_RELAXED)) __atomic_store_n(&hist->max, val, __ATOMIC_RELAXED);
+}
+
+void hist_add_mt(hist_t* hist, uint64_t val)
+{
+    __atomic_add_fetch(&hist->buckets[hist_idx(val)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->sum, val, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+    while (val > max && !__atomic_compare_exchange_n(&hist->max, &max, val, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// the snapshot is not atomic as a whole; count is taken from the buckets so it adds up
+void hist_get(const hist_t* hist, hist_t* snap)
+{
+    snap->count = 0;
+    snap->sum   = __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+    snap->max   = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+    for (int idx = 0; idx < HIST_BUCKETS; idx++)
+    {
+        snap->buckets[idx]  = __atomic_load_n(&hist->buckets[idx], __ATOMIC_RELAXED);
+        snap->count        += snap->buckets[idx];
+    }
+}
+
+uint64_t hist_pct(const hist_t* hist, double pct)
+{
+    if (hist->count == 0) return 0;
+
+    uint64_t rank = (uint64_t)(pct / 100.0 * hist->count + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0) rank = 1;
+    if (rank > hist->count) rank = hist->count;
+
+    for (int idx = 0; idx < HIST_BUCKETS; idx++)
+    {
+        seen += hist->buckets[idx];
+
+        if (seen >= rank)
+        {
+            uint64_t high = hist_high(idx);
+            return (high < hist->max) ? high : hist->max;
+        }
+    }
+
+    return hist->max;
+}
@@ -21,233 +21,2445 @@
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
 
+#include <linux/filter.h>
+#include <linux/io_uring.h>
+#include <linux/errqueue.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/timerfd.h>
 #include <sys/epoll.h>
 #include <sys/signalfd.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
 
 #include "mevel.h"
 
+// backend state of an event
+#define MEVEL_ST_ARMED      0x01    // an io_uring request is in flight
+#define MEVEL_ST_DEAD       0x02    // deleted; released with its last completion
+#define MEVEL_ST_READY      0x04    // on the still-ready list of its context
+#define MEVEL_ST_GROUPED    0x08    // waits for its group handler; a delete is finished by the handler's flush
+#define MEVEL_ST_FIRING     0x10    // its timer callback is running; a delete is finished by the loop
+
+#define MEVEL_URING_BGID    0
+
+// state of a buffered connection
+#define MEVEL_CN_BUSY       0x01    // its callback is running
+#define MEVEL_CN_FULL       0x02    // the output passed the high watermark
+#define MEVEL_CN_RAW        0x04    // not a socket; sent with writev
+#define MEVEL_CN_EOF        0x08    // the peer finished sending
+#define MEVEL_CN_SHUT       0x10    // closed once the output is sent
+#define MEVEL_CN_ZC         0x20    // SO_ZEROCOPY is enabled
+#define MEVEL_CN_NOZC       0x40    // SO_ZEROCOPY is not supported; zero-copy buffers are copied
+#define MEVEL_CN_MORE       0x80    // the read budget ran out with input left
+#define MEVEL_CN_YIELD      0x100   // the callback returned MEVEL_ERR_AGAIN with input buffered
+
+#define MEVEL_JOB_FILE      0       // file region sent with sendfile
+#define MEVEL_JOB_ZC        1       // caller buffer sent with MSG_ZEROCOPY
+
+// a file region or a zero-copy buffer queued on a buffered connection
+struct mevel_job {
+    struct mevel_job*   nxt;
+    int                 kind;
+    size_t              mark;       // output ring bytes written before the job
+    int                 fd;
+    off_t               off;
+    const char*         buf;        // rest of a zero-copy buffer
+    uint32_t            seq;        // zero-copy sends up to the last one of the buffer
+    size_t              len;        // bytes left to send
+    mevel_sent_fn*      done;
+    void*               arg;
+};
+
+// a task posted from another thread
+typedef struct {
+    mpsc_node_t         node;
+    mevel_post_fn*      fn;
+    void*               arg;
+} mevel_post_t;
+
+// a hook of the prepare, check or idle phase
+struct mevel_hook {
+    struct mevel_hook*  nxt;
+    int                 phase;
+    int                 dead;       // deleted; freed once no thread walks the hooks
+    mevel_post_fn*      fn;
+    void*               arg;
+};
+
+struct mevel_group {
+    mevel_group_fn*     fn;
+    void*               arg;
+};
+
+#define MEVEL_BATCH_GROW    2       // consecutive full waits before the batch doubles
+#define MEVEL_BATCH_SHRINK  64      // consecutive sparse waits before the batch halves
+
+
+// the shared state of a multi-threaded context is guarded by its lock
+static inline void mevel_lck(mevel_ctx_t* ctx)
+{
+    if (ctx->flags & MEVEL_CTX_MT) pthread_mutex_lock(&ctx->lock);
+}
+
+static inline void mevel_ulk(mevel_ctx_t* ctx)
+{
+    if (ctx->flags & MEVEL_CTX_MT) pthread_mutex_unlock(&ctx->lock);
+}
+
+// events come from the slab of their context, which is guarded like the registry
+static mevel_event_t* mevel_ev_get(mevel_ctx_t* ctx)
+{
+    if (ctx == NULL) return (mevel_event_t*) slab_heap(sizeof(mevel_event_t));
+
+    mevel_lck(ctx);
+    mevel_event_t* ev = (mevel_event_t*) slab_get(ctx->eslab);
+    mevel_ulk(ctx);
+
+    if (ev)
+    {
+        ev->conn    = NULL;
+        ev->dgram   = NULL;
+        ev->acc     = NULL;
+        ev->nxt     = NULL;
+        ev->prv     = NULL;
+        ev->rnxt    = NULL;
+        ev->rprv    = NULL;
+        ev->rflags  = 0;
+        ev->prio    = MEVEL_PRIO_NORMAL;
+        ev->group   = NULL;
+    }
+
+    return ev;
+}
+
+// the epoll set holding an event
+static inline int mevel_epfd(const mevel_ctx_t* ctx, const mevel_event_t* ev)
+{
+    return (ev->prio == MEVEL_PRIO_HIGH && ctx->hifd >= 0) ? ctx->hifd : ctx->epollfd;
+}
+
+static void mevel_ev_put(mevel_event_t* ev)
+{
+    if (ev->conn)
+    {
+        ring_rel(&ev->conn->in);
+        ring_rel(&ev->conn->out);
+
+        while (ev->conn->jobs)
+        {
+            struct mevel_job* job = ev->conn->jobs;
+            ev->conn->jobs = job->nxt;
+            free(job);
+        }
+
+        while (ev->conn->zcs)
+        {
+            struct mevel_job* job = ev->conn->zcs;
+            ev->conn->zcs = job->nxt;
+            free(job);
+        }
+
+        free(ev->conn);
+    }
+
+    if (ev->dgram)
+    {
+        mmsg_rel(&ev->dgram->in);
+        mmsg_rel(&ev->dgram->out);
+        free(ev->dgram);
+    }
+
+    slab_put(ev);
+}
+
+// registers an event in O(1); called with the lock held
+static void mevel_ev_lnk(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    ev->prv = NULL;
+    ev->nxt = ctx->evs;
+
+    if (ctx->evs) ctx->evs->prv = ev;
+
+    ctx->evs = ev;
+    ctx->size++;
+}
+
+static void mevel_rdy_del(mevel_ctx_t* ctx, mevel_event_t* ev);
+
+// unregisters and releases an event in O(1); called with the lock held
+static void mevel_ev_fre(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    mevel_rdy_del(ctx, ev);
+
+    // only the head has no predecessor; anything else was never added
+    if (ev->prv || ctx->evs == ev)
+    {
+        if (ev->prv) ev->prv->nxt = ev->nxt;
+        else ctx->evs = ev->nxt;
+
+        if (ev->nxt) ev->nxt->prv = ev->prv;
+
+        ctx->size--;
+    }
+
+    mevel_ev_put(ev);
+}
+
+// queues an event that yielded with input left; called with the lock held
+static void mevel_rdy_put(mevel_ctx_t* ctx, mevel_event_t* ev, int flags)
+{
+    ev->rflags = flags;
+
+    if (ev->state & MEVEL_ST_READY) return;
+
+    ev->state  |= MEVEL_ST_READY;
+    ev->rnxt    = NULL;
+    ev->rprv    = ctx->rlast;
+
+    if (ctx->rlast) ctx->rlast->rnxt = ev;
+    else ctx->ready = ev;
+
+    ctx->rlast = ev;
+    __atomic_store_n(&ctx->nready, ctx->nready + 1, __ATOMIC_RELAXED);
+}
+
+// unlinks an event from the still-ready list; called with the lock held
+static void mevel_rdy_del(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    if (!(ev->state & MEVEL_ST_READY)) return;
+
+    if (ev->rprv) ev->rprv->rnxt = ev->rnxt;
+    else ctx->ready = ev->rnxt;
+
+    if (ev->rnxt) ev->rnxt->rprv = ev->rprv;
+    else ctx->rlast = ev->rprv;
+
+    ev->state  &= ~MEVEL_ST_READY;
+    ev->rnxt    = NULL;
+    ev->rprv    = NULL;
+    __atomic_store_n(&ctx->nready, ctx->nready - 1, __ATOMIC_RELAXED);
+}
+
+// takes the oldest still-ready event; called with the lock held
+static mevel_event_t* mevel_rdy_get(mevel_ctx_t* ctx)
+{
+    mevel_event_t* ev = ctx->ready;
+
+    if (ev) mevel_rdy_del(ctx, ev);
+
+    return ev;
+}
+
+static mevel_post_t* mevel_post_new(mevel_post_fn* fn, void* arg)
+{
+    mevel_post_t* post = (mevel_post_t*) malloc(sizeof(mevel_post_t));
+
+    if (post)
+    {
+        post->node.ptr  = post;
+        post->fn        = fn;
+        post->arg       = arg;
+    }
+
+    return post;
+}
+
+// runs and frees a list of posted or deferred tasks, oldest first
+static void mevel_run_posts(mevel_ctx_t* ctx, mpsc_node_t* node)
+{
+    while (node)
+    {
+        mevel_post_t* post = (mevel_post_t*) node->ptr;
+
+        node = node->nxt;
+        post->fn(ctx, post->arg);
+        free(post);
+    }
+}
+
+static void mevel_free_posts(mpsc_t* list)
+{
+    for (mpsc_node_t* node = mpsc_get(list); node; )
+    {
+        mpsc_node_t* nxt = node->nxt;
+        free(node->ptr);
+        node = nxt;
+    }
+}
+
+// runs the posted tasks; drained whole, so one wakeup serves every post before it
+static mevel_err_t mevel_post_cb(mevel_event_t* ev, int flags)
+{
+    mevel_ctx_t*    ctx = ev->ctx;
+    uint64_t        count;
+
+    // a stop leaves the counter set so that every thread of the context wakes in turn
+    if (!__atomic_load_n(&ctx->running, __ATOMIC_ACQUIRE) || __atomic_load_n(&ctx->stopping, __ATOMIC_ACQUIRE))
+    {
+        return MEVEL_ERR_NONE;
+    }
+
+    // reset the counter before taking the list so no post is missed
+    if (read(ev->fd, &count, sizeof(uint64_t)) < 0) { /* spurious wakeup */ }
+
+    mevel_run_posts(ctx, mpsc_get(&ctx->posts));
+
+    return MEVEL_ERR_NONE;
+}
+
+// unlinks and frees the deleted hooks; called under the lock with no thread walking them
+static void mevel_hook_swp(mevel_ctx_t* ctx)
+{
+    for (int phase = 0; phase < MEVEL_PHASES; phase++)
+    {
+        struct mevel_hook** link = &ctx->hooks[phase];
+
+        while (*link)
+        {
+            struct mevel_hook* hook = *link;
+
+            if (hook->dead)
+            {
+                __atomic_store_n(link, hook->nxt, __ATOMIC_RELEASE);
+                free(hook);
+            }
+            else link = &hook->nxt;
+        }
+    }
+
+    ctx->dead = 0;
+}
+
+static void mevel_run_hooks(mevel_ctx_t* ctx, int phase)
+{
+    // nothing to lock for in the common case of no hooks at all
+    if (__atomic_load_n(&ctx->hooks[phase], __ATOMIC_ACQUIRE) == NULL) return;
+
+    mevel_lck(ctx);
+    struct mevel_hook* hook = ctx->hooks[phase];
+    ctx->hooking++;
+    mevel_ulk(ctx);
+
+    // hooks are only appended while walking, so the links stay valid without the lock
+    for (; hook; hook = __atomic_load_n(&hook->nxt, __ATOMIC_ACQUIRE))
+    {
+        if (!__atomic_load_n(&hook->dead, __ATOMIC_ACQUIRE)) hook->fn(ctx, hook->arg);
+    }
+
+    mevel_lck(ctx);
+    if (--ctx->hooking == 0 && ctx->dead) mevel_hook_swp(ctx);
+    mevel_ulk(ctx);
+}
 
 mevel_ctx_t* mevel_ini()
 {
-    mevel_ctx_t* ctx = (mevel_ctx_t*) malloc(sizeof(mevel_ctx_t));
+    return mevel_ini_cfg(NULL);
+}
+
+mevel_ctx_t* mevel_ini_cfg(const mevel_cfg_t* cfg)
+{
+    mevel_ctx_t* ctx = (mevel_ctx_t*) calloc(1, sizeof(mevel_ctx_t));
+
+    if (ctx == NULL) return NULL;
+
+    pthread_mutex_init(&ctx->lock, NULL);
+
+    ctx->flags      = cfg ? cfg->flags : 0;
+    ctx->backlog    = (cfg && cfg->backlog > 0) ? cfg->backlog : SOMAXCONN;
+    ctx->accepts    = (cfg && cfg->accepts > 0) ? cfg->accepts : MEVEL_MAX_ACCEPTS;
+    ctx->budget     = (cfg && cfg->budget > 0) ? cfg->budget : MEVEL_READ_BUDGET;
+    ctx->nevents    = (cfg && cfg->nevents > 0) ? cfg->nevents : MEVEL_MAX_EVENTS;
+    ctx->maxevents  = (cfg && cfg->maxevents > 0) ? cfg->maxevents : MEVEL_MAX_BATCH;
+    if (ctx->maxevents < ctx->nevents) ctx->maxevents = ctx->nevents;
+    ctx->stats.nevents = ctx->nevents;
+    ctx->running    = 0x00;
+    ctx->stopping   = 0x00;
+    ctx->epollfd    = -1;
+    ctx->hifd       = -1;
+    ctx->postfd     = -1;
+
+    mpsc_ini(&ctx->posts);
+    mpsc_ini(&ctx->defers);
+
+    // io_uring completions are reaped by a single thread
+    if ((ctx->flags & MEVEL_CTX_URING) && (ctx->flags & MEVEL_CTX_MT))
+    {
+        mevel_rel(ctx);
+        return NULL;
+    }
+
+    if (ctx->flags & MEVEL_CTX_URING)
+    {
+        ctx->uring = uring_ini(MEVEL_URING_ENTRIES);
+
+        if (ctx->uring == NULL || uring_buf_ini(ctx->uring, MEVEL_URING_BUFS, MEVEL_RCV_SIZE, MEVEL_URING_BGID) < 0)
+        {
+            mevel_rel(ctx);
+            return NULL;
+        }
+    }
+    else
+    {
+        ctx->epollfd = epoll_create1(EPOLL_CLOEXEC);
+
+        if (ctx->epollfd < 0)
+        {
+            mevel_rel(ctx);
+            return NULL;
+        }
+    }
+
+    if ((ctx->flags & MEVEL_CTX_PRIO) && ctx->uring == NULL)
+    {
+        // the high set wakes the main one; its entry carries no event
+        epoll_event_t hev = {0};
+        hev.events = EPOLLIN;
+
+        ctx->hifd = epoll_create1(EPOLL_CLOEXEC);
+
+        if (ctx->hifd < 0 || epoll_ctl(ctx->epollfd, EPOLL_CTL_ADD, ctx->hifd, &hev) < 0)
+        {
+            mevel_rel(ctx);
+            return NULL;
+        }
+    }
+
+    size_t count = (cfg && !(ctx->flags & MEVEL_CTX_NOSLAB)) ? cfg->prealloc : 0;
+    size_t chunk = (ctx->flags & MEVEL_CTX_NOSLAB) ? 0 : MEVEL_SLAB_CHUNK;
+
+    ctx->eslab  = slab_ini(sizeof(mevel_event_t), count, chunk);
+    ctx->wheel  = wheel_ini(wheel_clk());
+
+    if (ctx->flags & MEVEL_CTX_METRICS) ctx->metrics = (mevel_metrics_t*) calloc(1, sizeof(mevel_metrics_t));
+
+    if (ctx->flags & MEVEL_CTX_TRACE)
+    {
+        ctx->trace = (trace_t*) calloc(1, sizeof(trace_t));
+
+        if (ctx->trace && trace_ini(ctx->trace, (cfg && cfg->trace) ? cfg->trace : MEVEL_TRACE_SIZE) < 0)
+        {
+            free(ctx->trace);
+            ctx->trace = NULL;
+        }
+    }
+
+    if (ctx->eslab == NULL || ctx->wheel == NULL || ((ctx->flags & MEVEL_CTX_METRICS) && ctx->metrics == NULL) ||
+        ((ctx->flags & MEVEL_CTX_TRACE) && ctx->trace == NULL))
+    {
+        mevel_rel(ctx);
+        return NULL;
+    }
+
+    ctx->postfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    mevel_event_t* ev = (ctx->postfd < 0) ? NULL : mevel_ini_fio(ctx, mevel_post_cb, ctx->postfd, MEVEL_READ);
+
+    if (ev == NULL || mevel_add(ctx, ev) != MEVEL_ERR_NONE)
+    {
+        if (ev) mevel_rel_ev(ev);
+        mevel_rel(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+void    mevel_stp(mevel_ctx_t* ctx)
+{
+    uint64_t one = 1;
+
+    if (ctx == NULL) return;
+
+    __atomic_store_n(&ctx->stopping, 0xFF, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ctx->running, 0x00, __ATOMIC_SEQ_CST);
+
+    if (write(ctx->postfd, &one, sizeof(uint64_t)) < 0) { /* counter saturated; already readable */ }
+}
+
+mevel_err_t mevel_post(mevel_ctx_t* ctx, mevel_post_fn* fn, void* arg)
+{
+    if (ctx == NULL || fn == NULL) return MEVEL_ERR_NULL;
+
+    mevel_post_t* post = mevel_post_new(fn, arg);
+
+    if (post == NULL) return MEVEL_ERR_ADD;
+
+    // only the post that finds the list empty wakes the loop; the rest ride along
+    if (mpsc_put(&ctx->posts, &post->node))
+    {
+        uint64_t one = 1;
+        if (write(ctx->postfd, &one, sizeof(uint64_t)) < 0) { /* counter saturated; already readable */ }
+    }
+
+    return MEVEL_ERR_NONE;
+}
+
+mevel_err_t mevel_get_metrics(mevel_ctx_t* ctx, mevel_metrics_t* snap)
+{
+    if (ctx == NULL || snap == NULL || ctx->metrics == NULL) return MEVEL_ERR_NULL;
+
+    for (int type = 0; type < MEVEL_TYPES; type++) hist_get(&ctx->metrics->cb[type], &snap->cb[type]);
+
+    hist_get(&ctx->metrics->batch, &snap->batch);
+    hist_get(&ctx->metrics->lag, &snap->lag);
+
+    snap->wait_ns = __atomic_load_n(&ctx->metrics->wait_ns, __ATOMIC_RELAXED);
+    snap->busy_ns = __atomic_load_n(&ctx->metrics->busy_ns, __ATOMIC_RELAXED);
+
+    return MEVEL_ERR_NONE;
+}
+
+size_t mevel_get_trace(mevel_ctx_t* ctx, trace_rec_t* out, size_t max)
+{
+    if (ctx == NULL || out == NULL || ctx->trace == NULL) return 0;
+
+    return trace_get(ctx->trace, out, max);
+}
+
+mevel_err_t mevel_dump_trace(mevel_ctx_t* ctx, int fd)
+{
+    if (ctx == NULL || ctx->trace == NULL) return MEVEL_ERR_NULL;
+
+    return (trace_dump(ctx->trace, fd) < 0) ? MEVEL_ERR_FIO : MEVEL_ERR_NONE;
+}
+
+mevel_err_t mevel_defer(mevel_ctx_t* ctx, mevel_post_fn* fn, void* arg)
+{
+    if (ctx == NULL || fn == NULL) return MEVEL_ERR_NULL;
+
+    mevel_post_t* post = mevel_post_new(fn, arg);
+
+    if (post == NULL) return MEVEL_ERR_ADD;
+
+    // the loop does not block while the list is non-empty; no wakeup needed
+    mpsc_put(&ctx->defers, &post->node);
+
+    return MEVEL_ERR_NONE;
+}
+
+mevel_hook_t* mevel_add_hook(mevel_ctx_t* ctx, int phase, mevel_post_fn* fn, void* arg)
+{
+    if (ctx == NULL || fn == NULL || phase < 0 || phase >= MEVEL_PHASES) return NULL;
+
+    struct mevel_hook* hook = (struct mevel_hook*) malloc(sizeof(struct mevel_hook));
+
+    if (hook == NULL) return NULL;
+
+    hook->nxt   = NULL;
+    hook->phase = phase;
+    hook->dead  = 0;
+    hook->fn    = fn;
+    hook->arg   = arg;
+
+    mevel_lck(ctx);
+
+    struct mevel_hook** link = &ctx->hooks[phase];
+    while (*link) link = &(*link)->nxt;
+
+    // published last; a thread walking the hooks sees either nothing or all of it
+    __atomic_store_n(link, hook, __ATOMIC_RELEASE);
+    if (phase == MEVEL_PHASE_IDLE) __atomic_add_fetch(&ctx->idle, 1, __ATOMIC_RELAXED);
+
+    mevel_ulk(ctx);
+
+    return hook;
+}
+
+mevel_err_t mevel_del_hook(mevel_ctx_t* ctx, mevel_hook_t* hook)
+{
+    if (ctx == NULL || hook == NULL) return MEVEL_ERR_NULL;
+
+    mevel_lck(ctx);
+
+    if (hook->dead)
+    {
+        mevel_ulk(ctx);
+        return MEVEL_ERR_DEL;
+    }
+
+    __atomic_store_n(&hook->dead, 1, __ATOMIC_RELEASE);
+    if (hook->phase == MEVEL_PHASE_IDLE) __atomic_sub_fetch(&ctx->idle, 1, __ATOMIC_RELAXED);
+
+    // a hook may delete itself or another one of the same walk
+    ctx->dead++;
+    if (ctx->hooking == 0) mevel_hook_swp(ctx);
+
+    mevel_ulk(ctx);
+
+    return MEVEL_ERR_NONE;
+}
+
+mevel_err_t mevel_get_stats(mevel_ctx_t* ctx, mevel_stats_t* stats)
+{
+    if (ctx == NULL || stats == NULL) return MEVEL_ERR_NULL;
+
+    stats->nevents  = __atomic_load_n(&ctx->stats.nevents, __ATOMIC_RELAXED);
+    stats->waits    = __atomic_load_n(&ctx->stats.waits, __ATOMIC_RELAXED);
+    stats->full     = __atomic_load_n(&ctx->stats.full, __ATOMIC_RELAXED);
+    stats->events   = __atomic_load_n(&ctx->stats.events, __ATOMIC_RELAXED);
+
+    return MEVEL_ERR_NONE;
+}
+
+void mevel_batch_ini(mevel_batch_t* batch, int min, int max)
+{
+    batch->min  = (min > 0) ? min : MEVEL_MAX_EVENTS;
+    batch->max  = (max > batch->min) ? max : batch->min;
+    batch->size = batch->min;
+    batch->full = 0;
+    batch->idle = 0;
+}
+
+int mevel_batch_adj(mevel_batch_t* batch, int nfds)
+{
+    if (nfds >= batch->size)
+    {
+        batch->idle = 0;
+
+        // more events were probably left behind in the ready list
+        if (++batch->full >= MEVEL_BATCH_GROW && batch->size < batch->max)
+        {
+            batch->size = (batch->size > batch->max / 2) ? batch->max : batch->size * 2;
+            batch->full = 0;
+        }
+    }
+    else
+    {
+        batch->full = 0;
+
+        if (nfds < batch->size / 4 && batch->size > batch->min)
+        {
+            if (++batch->idle >= MEVEL_BATCH_SHRINK)
+            {
+                batch->size = (batch->size / 2 < batch->min) ? batch->min : batch->size / 2;
+                batch->idle = 0;
+            }
+        }
+        else batch->idle = 0;
+    }
+
+    return batch->size;
+}
+
+void    mevel_rel(mevel_ctx_t* ctx)
+{
 
     if (ctx)
     {
-	    ctx->epollfd = epoll_create1(EPOLL_CLOEXEC);
+        while (ctx->evs)
+        {
+            mevel_event_t* ev = ctx->evs;
+            ctx->evs = ev->nxt;
+            mevel_ev_put(ev);
+        }
+
+        mevel_free_posts(&ctx->posts);
+        mevel_free_posts(&ctx->defers);
+
+        for (int phase = 0; phase < MEVEL_PHASES; phase++)
+        {
+            while (ctx->hooks[phase])
+            {
+                struct mevel_hook* hook = ctx->hooks[phase];
+                ctx->hooks[phase] = hook->nxt;
+                free(hook);
+            }
+        }
+
+        slab_rel(ctx->eslab);
+        wheel_rel(ctx->wheel);
+        uring_rel(ctx->uring);
+        free(ctx->metrics);
+        if (ctx->trace) trace_rel(ctx->trace);
+        free(ctx->trace);
+        pthread_mutex_destroy(&ctx->lock);
+
+        if (ctx->postfd >= 0) close(ctx->postfd);
+        if (ctx->epollfd > 0) close(ctx->epollfd);
+        if (ctx->hifd >= 0) close(ctx->hifd);
+        free(ctx);
+        ctx = NULL;
+    }
+}
+
+// invokes the callback and removes the event when asked to; the event
+// must not be touched afterwards unless the result is MEVEL_ERR_NONE or MEVEL_ERR_AGAIN
+static mevel_err_t mevel_dispatch(mevel_ctx_t* ctx, mevel_event_t* ev, int flags)
+{
+    mevel_err_t cbr = ev->cb(ev, flags);
+
+    if (cbr != MEVEL_ERR_NONE && cbr != MEVEL_ERR_AGAIN) mevel_del(ctx, ev);
+
+    return cbr;
+}
+
+// runs the batch handler of a group for a single event, like mevel_dispatch
+static mevel_err_t mevel_run_grp(mevel_ctx_t* ctx, mevel_event_t* ev, int flags)
+{
+    mevel_item_t item = { ev, flags, MEVEL_ERR_NONE, ev->group };
+
+    item.group->fn(ctx, &item, 1, item.group->arg);
+
+    if (item.ret != MEVEL_ERR_NONE && item.ret != MEVEL_ERR_AGAIN) mevel_del(ctx, ev);
+
+    return item.ret;
+}
+
+static inline uint64_t mevel_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// the metrics of a single-threaded context have one writer and need no atomic updates
+static void mevel_met_add(mevel_ctx_t* ctx, hist_t* hist, uint64_t val)
+{
+    if (ctx->flags & MEVEL_CTX_MT) hist_add_mt(hist, val);
+    else hist_add(hist, val);
+}
+
+static void mevel_met_sum(mevel_ctx_t* ctx, uint64_t* sum, uint64_t val)
+{
+    if (ctx->flags & MEVEL_CTX_MT) __atomic_add_fetch(sum, val, __ATOMIC_RELAXED);
+    else __atomic_store_n(sum, __atomic_load_n(sum, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+}
+
+static __thread uint32_t mevel_tid = 0;
+
+static void mevel_trc_add(mevel_ctx_t* ctx, int type, int fd, int flags, int err, uint64_t start, uint64_t end)
+{
+    trace_rec_t rec;
+
+    if (mevel_tid == 0) mevel_tid = (uint32_t) syscall(SYS_gettid);
+
+    rec.seq     = 0;
+    rec.start   = start;
+    rec.end     = end;
+    rec.fd      = fd;
+    rec.flags   = (uint32_t) flags;
+    rec.tid     = mevel_tid;
+    rec.type    = (uint16_t) type;
+    rec.err     = (int16_t) err;
+
+    if (ctx->flags & MEVEL_CTX_MT) trace_add_mt(ctx->trace, &rec);
+    else trace_add(ctx->trace, &rec);
+}
+
+// metrics and tracing share the clock readings of the loop
+static inline int mevel_timed(const mevel_ctx_t* ctx)
+{
+    return ctx->metrics != NULL || ctx->trace != NULL;
+}
+
+// a callback of the given type ran since *stamp; the end is the start of the next one
+static void mevel_met_cb(mevel_ctx_t* ctx, int type, int fd, int flags, mevel_err_t cbr, uint64_t* stamp)
+{
+    uint64_t now = mevel_ns();
+
+    if (ctx->metrics) mevel_met_add(ctx, &ctx->metrics->cb[type - MEVEL_TYPE_IO], now - *stamp);
+    if (ctx->trace) mevel_trc_add(ctx, type, fd, flags, cbr, *stamp, now);
+    *stamp = now;
+}
+
+// the loop is about to block; busy since it woke up
+static uint64_t mevel_met_wait(mevel_ctx_t* ctx, uint64_t woke)
+{
+    uint64_t now = mevel_ns();
+
+    if (ctx->metrics) mevel_met_sum(ctx, &ctx->metrics->busy_ns, now - woke);
+
+    return now;
+}
+
+static uint64_t mevel_met_wake(mevel_ctx_t* ctx, uint64_t waited, int timeout)
+{
+    uint64_t now = mevel_ns();
+
+    if (ctx->metrics) mevel_met_sum(ctx, &ctx->metrics->wait_ns, now - waited);
+    if (ctx->trace) mevel_trc_add(ctx, TRACE_WAIT, -1, timeout, MEVEL_ERR_NONE, waited, now);
+
+    return now;
+}
+
+static void mevel_run_timers(mevel_ctx_t* ctx)
+{
+    uint64_t        now     = wheel_clk();
+    wheel_node_t*   node    = NULL;
+
+    for (;;)
+    {
+        mevel_lck(ctx);
+        node = wheel_pop(ctx->wheel, now);
+        if (node) ((mevel_event_t*) node->ptr)->state |= MEVEL_ST_FIRING;
+        mevel_ulk(ctx);
+
+        if (node == NULL) break;
+
+        mevel_event_t*  ev  = (mevel_event_t*) node->ptr;
+        uint64_t        exp = 1;
+
+        // another thread may have advanced the wheel past our clock reading
+        if (node->period && now > node->expire) exp += (now - node->expire) / node->period;
+
+        uint64_t        nxt = node->expire + exp * node->period;
+        uint64_t        stamp = 0;
+
+        if (mevel_timed(ctx)) stamp = mevel_ns();
+
+        if (ctx->metrics)
+        {
+            mevel_met_add(ctx, &ctx->metrics->lag, (stamp > node->expire * 1000000) ? stamp - node->expire * 1000000 : 0);
+        }
+
+        // the callback may reschedule, cancel or delete the timer itself; a periodic
+        // timer is queued again only afterwards so no two threads run it at once
+        mevel_err_t cbr = ev->cb(ev, (int) exp);
+
+        if (mevel_timed(ctx)) mevel_met_cb(ctx, MEVEL_TYPE_TIMER, -1, (int) exp, cbr, &stamp);
+
+        mevel_lck(ctx);
+        ev->state &= ~MEVEL_ST_FIRING;
+
+        // a delete during the callback left the release to us
+        if ((ev->state & MEVEL_ST_DEAD) || (cbr != MEVEL_ERR_NONE && cbr != MEVEL_ERR_AGAIN))
+        {
+            wheel_del(ctx->wheel, node);
+            mevel_ev_fre(ctx, ev);
+        }
+        else if (node->period && !wheel_node_linked(node)) wheel_add(ctx->wheel, node, nxt);
+        mevel_ulk(ctx);
+    }
+}
+
+// registers an accepted connection with the callback and mask of its listener
+static void mevel_acc(mevel_ctx_t* ctx, mevel_event_t* lst, int fd)
+{
+    mevel_event_t* ev = lst->acc ? lst->acc(ctx, lst->cb, fd, lst->evmask)
+                                 : mevel_ini_fio(ctx, lst->cb, fd, lst->evmask);
+
+    if (ev == NULL)
+    {
+        close(fd);
+        return;
+    }
+
+    ev->prio = lst->prio;
+    if (ev->type == MEVEL_TYPE_IO) ev->group = lst->group;
+
+    if (mevel_add(ctx, ev) != MEVEL_ERR_NONE)
+    {
+        close(fd);
+        mevel_rel_ev(ev);
+    }
+}
+
+// drains the accept queue up to the per-iteration budget; what is left
+// is reported again by the level-triggered listener
+static void mevel_run_acc(mevel_ctx_t* ctx, mevel_event_t* lst)
+{
+    for (int count = 0; count < ctx->accepts; count++)
+    {
+        int fd = accept4(lst->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd >= 0)
+        {
+            mevel_acc(ctx, lst, fd);
+        }
+        else if (errno != EINTR && errno != ECONNABORTED)
+        {
+            // EAGAIN, or out of descriptors/memory until the next iteration
+            break;
+        }
+    }
+}
+
+// sleep until the nearest timer deadline
+static int mevel_timeout(mevel_ctx_t* ctx)
+{
+    // pending deferred tasks, idle hooks and still-ready events only poll
+    if (__atomic_load_n(&ctx->idle, __ATOMIC_RELAXED) ||
+        __atomic_load_n(&ctx->nready, __ATOMIC_RELAXED) ||
+        __atomic_load_n(&ctx->defers.head, __ATOMIC_RELAXED)) return 0;
+
+    mevel_lck(ctx);
+    int timeout = wheel_nxt(ctx->wheel, wheel_clk());
+    mevel_ulk(ctx);
+
+    if (timeout < 0 || timeout > MEVEL_MAX_TIMEOUT) timeout = MEVEL_MAX_TIMEOUT;
+
+    return timeout;
+}
+
+// the rest of an iteration once its events and timers are dispatched
+static void mevel_run_phases(mevel_ctx_t* ctx, int idle)
+{
+    if (__atomic_load_n(&ctx->defers.head, __ATOMIC_RELAXED)) mevel_run_posts(ctx, mpsc_get(&ctx->defers));
+
+    mevel_run_hooks(ctx, MEVEL_PHASE_CHECK);
+
+    if (idle) mevel_run_hooks(ctx, MEVEL_PHASE_IDLE);
+}
+
+// reads one buffer per turn; a full one may leave more behind
+static mevel_err_t mevel_run_rcv(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    char    buf[MEVEL_RCV_SIZE];
+    ssize_t len = read(ev->fd, buf, MEVEL_RCV_SIZE);
+
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return MEVEL_ERR_NONE;
+
+    ev->rbuf = buf;
+
+    mevel_err_t cbr = mevel_dispatch(ctx, ev, (len < 0) ? -errno : (int) len);
+
+    return (cbr == MEVEL_ERR_NONE && len == MEVEL_RCV_SIZE) ? MEVEL_ERR_AGAIN : cbr;
+}
+
+static void mevel_uring_upd(mevel_ctx_t* ctx, mevel_event_t* ev);
+
+// watches EPOLLOUT only while output is pending; apply is zero when the
+// caller re-arms the event itself after the callback
+static void mevel_conn_mod(mevel_ctx_t* ctx, mevel_event_t* ev, int apply)
+{
+    mevel_conn_t*   conn = ev->conn;
+    uint32_t        want = ev->event.events & ~EPOLLOUT;
+
+    // a pending close waits for EPOLLOUT too, which also wakes it when nothing is left to send
+    if (ring_len(&conn->out) || conn->jobs || ((conn->state & MEVEL_CN_SHUT) && conn->zcs == NULL)) want |= EPOLLOUT;
+    if (conn->state & MEVEL_CN_EOF) want &= ~(EPOLLIN | EPOLLRDHUP);
+    if (want == ev->event.events) return;
+
+    ev->event.events = want;
+
+    if (!apply || ctx == NULL) return;
+
+    if (ctx->uring)
+    {
+        if (ev->state & MEVEL_ST_ARMED) mevel_uring_upd(ctx, ev);
+    }
+    else epoll_ctl(mevel_epfd(ctx, ev), EPOLL_CTL_MOD, ev->fd, &ev->event);
+}
+
+// drains the socket into the input ring up to the read budget; returns the callback flags
+static int mevel_conn_rcv(mevel_event_t* ev, int flags)
+{
+    mevel_conn_t*   conn = ev->conn;
+    int             what = 0;
+    size_t          got  = 0;
+
+    if (conn->state & MEVEL_CN_EOF) return (flags & EPOLLERR) ? MEVEL_HUP | MEVEL_ERROR : 0;
+    if (conn->in.cap == 0 && ring_ini(&conn->in, MEVEL_CONN_SIZE) < 0) return MEVEL_HUP | MEVEL_ERROR;
+
+    for (;;)
+    {
+        struct iovec iov[2];
+
+        if (ring_spc(&conn->in) == 0 && ring_res(&conn->in, 1, MEVEL_CONN_MAX) < 0)
+        {
+            return what | MEVEL_HUP | MEVEL_ERROR;
+        }
+
+        size_t  spc = ring_spc(&conn->in);
+        int     cnt = ring_iov_wr(&conn->in, iov);
+        ssize_t len = readv(ev->fd, iov, cnt);
+
+        if (len > 0)
+        {
+            ring_adv_wr(&conn->in, (size_t) len);
+            what |= MEVEL_READ;
+            got  += (size_t) len;
+
+            // a short read emptied the socket; a hangup still has to be read to its end
+            if ((size_t) len < spc && !(flags & (EPOLLRDHUP | EPOLLHUP))) break;
+
+            // the rest waits for the next turn so other events are not starved
+            if (got >= ev->ctx->budget)
+            {
+                conn->state |= MEVEL_CN_MORE;
+                break;
+            }
+        }
+        else if (len == 0)
+        {
+            conn->state |= MEVEL_CN_EOF;
+            return what | MEVEL_RDHUP;
+        }
+        else if (errno == EINTR) continue;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        else return what | MEVEL_HUP | MEVEL_ERROR;
+    }
+
+    return what;
+}
+
+// sends up to limit bytes of the output ring; returns 1 once they are sent, 0 when
+// the socket is full and -1 on error
+static int mevel_conn_snd_ring(mevel_event_t* ev, size_t limit)
+{
+    mevel_conn_t*   conn = ev->conn;
+
+    while (limit)
+    {
+        struct iovec    iov[2];
+        struct msghdr   msg;
+
+        memset(&msg, 0x00, sizeof(struct msghdr));
+        msg.msg_iov     = iov;
+        msg.msg_iovlen  = ring_iov_rd(&conn->out, iov);
+
+        // a file region may follow part of the ring
+        if (iov[0].iov_len >= limit)
+        {
+            iov[0].iov_len  = limit;
+            msg.msg_iovlen  = 1;
+        }
+        else if (msg.msg_iovlen == 2 && iov[0].iov_len + iov[1].iov_len > limit)
+        {
+            iov[1].iov_len  = limit - iov[0].iov_len;
+        }
+
+        // sendmsg is writev that does not raise SIGPIPE on a closed peer
+        ssize_t len = (conn->state & MEVEL_CN_RAW) ? writev(ev->fd, iov, msg.msg_iovlen)
+                                                   : sendmsg(ev->fd, &msg, MSG_NOSIGNAL);
+
+        if (len > 0)
+        {
+            ring_adv_rd(&conn->out, (size_t) len);
+            conn->sent  += (size_t) len;
+            limit       -= (size_t) len;
+
+            // a short write filled the socket buffer; EPOLLOUT reports when it drains
+            if (limit) return 0;
+        }
+        else if (len < 0 && errno == ENOTSOCK && !(conn->state & MEVEL_CN_RAW)) conn->state |= MEVEL_CN_RAW;
+        else if (len < 0 && errno == EINTR) continue;
+        else if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        else return -1;
+    }
+
+    return 1;
+}
+
+// sends the rest of a file region; returns 1 once it is sent, 0 when the socket
+// is full and -1 on error or when the file ends early
+static int mevel_conn_snd_file(mevel_event_t* ev, struct mevel_job* job)
+{
+    sigset_t    pipe;
+    sigset_t    mask;
+    sigset_t    pending;
+    int         ret = 1;
+
+    // sendfile has no MSG_NOSIGNAL; hold SIGPIPE back and discard the one it raised
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    sigpending(&pending);
+    pthread_sigmask(SIG_BLOCK, &pipe, &mask);
+
+    while (job->len)
+    {
+        ssize_t len = sendfile(ev->fd, job->fd, &job->off, job->len);
+
+        if (len > 0) job->len -= (size_t) len;
+        else if (len == 0) { errno = ENODATA; ret = -1; break; }
+        else if (errno == EINTR) continue;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) { ret = 0; break; }
+        else { ret = -1; break; }
+    }
+
+    if (ret < 0 && errno == EPIPE && !sigismember(&pending, SIGPIPE))
+    {
+        struct timespec zero = { 0, 0 };
+
+        sigtimedwait(&pipe, NULL, &zero);
+        errno = EPIPE;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+    return ret;
+}
+
+// sends the rest of a zero-copy buffer; returns as mevel_conn_snd_file does
+static int mevel_conn_snd_zc(mevel_event_t* ev, struct mevel_job* job)
+{
+    mevel_conn_t*   conn    = ev->conn;
+    int             one     = 1;
+
+    if (!(conn->state & (MEVEL_CN_ZC | MEVEL_CN_NOZC)))
+    {
+        if (setsockopt(ev->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(int)) == 0) conn->state |= MEVEL_CN_ZC;
+        else conn->state |= MEVEL_CN_NOZC;
+    }
+
+    int flags = MSG_NOSIGNAL | ((conn->state & MEVEL_CN_ZC) ? MSG_ZEROCOPY : 0);
+
+    while (job->len)
+    {
+        ssize_t len = send(ev->fd, job->buf, job->len, flags);
+
+        if (len > 0)
+        {
+            job->buf += len;
+            job->len -= (size_t) len;
+
+            // every zero-copy send that took data is acknowledged by its own sequence number
+            if (flags & MSG_ZEROCOPY) job->seq = ++conn->zseq;
+        }
+        else if (len < 0 && errno == EINTR) continue;
+        // ENOBUFS: too many sends await completion; the error queue wakes the loop
+        else if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) return 0;
+        else return -1;
+    }
+
+    return 1;
+}
+
+// runs the completion of a finished transfer; output it queues is sent by the caller
+static void mevel_conn_fin(mevel_event_t* ev, struct mevel_job* job, int err)
+{
+    mevel_conn_t*   conn = ev->conn;
+    int             busy = conn->state & MEVEL_CN_BUSY;
+
+    if (job->done)
+    {
+        conn->state |= MEVEL_CN_BUSY;
+        job->done(ev, job->arg, err);
+        conn->state = (conn->state & ~MEVEL_CN_BUSY) | busy;
+    }
+
+    free(job);
+}
+
+// sends the output ring and the file regions between it in order
+static int mevel_conn_snd(mevel_event_t* ev)
+{
+    mevel_conn_t*   conn = ev->conn;
+
+    for (;;)
+    {
+        struct mevel_job*   job = conn->jobs;
+        int                 ret = mevel_conn_snd_ring(ev, job ? job->mark - conn->sent : ring_len(&conn->out));
+
+        if (ret < 0) return MEVEL_HUP | MEVEL_ERROR;
+        if (ret == 0 || job == NULL) break;
+
+        ret = (job->kind == MEVEL_JOB_ZC) ? mevel_conn_snd_zc(ev, job) : mevel_conn_snd_file(ev, job);
+
+        if (ret == 0) break;
+
+        conn->jobs = job->nxt;
+        if (conn->jobs == NULL) conn->last = NULL;
+
+        // zero-copy buffers are released by their completion notification
+        if (ret > 0 && job->kind == MEVEL_JOB_ZC && (int32_t)(job->seq - conn->zdone) > 0)
+        {
+            job->nxt = NULL;
+            if (conn->zlast) conn->zlast->nxt = job;
+            else conn->zcs = job;
+            conn->zlast = job;
+            continue;
+        }
+
+        // the stream is broken once a job could not be sent in full
+        mevel_conn_fin(ev, job, (ret < 0) ? errno : 0);
+
+        if (ret < 0) return MEVEL_HUP | MEVEL_ERROR;
+    }
+
+    if ((conn->state & MEVEL_CN_FULL) && ring_len(&conn->out) <= conn->low)
+    {
+        conn->state &= ~MEVEL_CN_FULL;
+        return MEVEL_WRITE;
+    }
+
+    return 0;
+}
+
+// completes the transfers still queued on a connection about to be deleted
+static void mevel_conn_drop(mevel_event_t* ev)
+{
+    mevel_conn_t* conn = ev->conn;
+
+    while (conn->jobs)
+    {
+        struct mevel_job* job = conn->jobs;
+
+        conn->jobs = job->nxt;
+        if (conn->jobs == NULL) conn->last = NULL;
+
+        mevel_conn_fin(ev, job, ECANCELED);
+    }
+
+    // the notifications of buffers in flight are lost with the socket
+    while (conn->zcs)
+    {
+        struct mevel_job* job = conn->zcs;
+
+        conn->zcs = job->nxt;
+        if (conn->zcs == NULL) conn->zlast = NULL;
+
+        mevel_conn_fin(ev, job, ECANCELED);
+    }
+}
+
+// reads zero-copy completions from the error queue and releases the buffers they cover;
+// returns 1 if the error queue held anything
+static int mevel_conn_zc_rcv(mevel_event_t* ev)
+{
+    mevel_conn_t*   conn = ev->conn;
+    int             seen = 0;
+
+    for (;;)
+    {
+        char            ctl[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct msghdr   msg;
+        struct cmsghdr* cmsg = NULL;
+
+        memset(&msg, 0x00, sizeof(struct msghdr));
+        msg.msg_control     = ctl;
+        msg.msg_controllen  = sizeof(ctl);
+
+        if (recvmsg(ev->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        seen = 1;
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) continue;
+
+            struct sock_extended_err serr;
+            memcpy(&serr, CMSG_DATA(cmsg), sizeof(struct sock_extended_err));
+
+            if (serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr.ee_errno != 0) continue;
+
+            // the range ee_info..ee_data is done; sends complete in order on a stream
+            if ((int32_t)(serr.ee_data + 1 - conn->zdone) > 0) conn->zdone = serr.ee_data + 1;
+        }
+    }
+
+    while (conn->zcs && (int32_t)(conn->zcs->seq - conn->zdone) <= 0)
+    {
+        struct mevel_job* job = conn->zcs;
+
+        conn->zcs = job->nxt;
+        if (conn->zcs == NULL) conn->zlast = NULL;
+
+        mevel_conn_fin(ev, job, 0);
+    }
+
+    return seen;
+}
+
+static mevel_err_t mevel_run_conn(mevel_ctx_t* ctx, mevel_event_t* ev, int flags)
+{
+    mevel_conn_t*   conn = ev->conn;
+    mevel_err_t     cbr  = MEVEL_ERR_NONE;
+    int             what = 0;
+
+    conn->state &= ~MEVEL_CN_MORE;
+
+    // zero-copy completions raise EPOLLERR without a socket error
+    if ((flags & EPOLLERR) && (conn->state & MEVEL_CN_ZC) && mevel_conn_zc_rcv(ev)) flags &= ~EPOLLERR;
+
+    if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) what |= mevel_conn_rcv(ev, flags);
+    if (flags & EPOLLOUT) what |= mevel_conn_snd(ev);
+
+    // a callback that yielded is handed the input it left in the ring again
+    if (conn->state & MEVEL_CN_YIELD)
+    {
+        conn->state &= ~MEVEL_CN_YIELD;
+        if (ring_len(&conn->in)) what |= MEVEL_READ;
+    }
+
+    // output queued by the callback goes out in one write once it returns,
+    // which may report the drain to the callback again
+    while (what)
+    {
+        conn->state |= MEVEL_CN_BUSY;
+        cbr = ev->cb(ev, what);
+        conn->state &= ~MEVEL_CN_BUSY;
+
+        // the callback takes another turn before the next wait
+        if (cbr == MEVEL_ERR_AGAIN)
+        {
+            conn->state |= MEVEL_CN_MORE | MEVEL_CN_YIELD;
+            cbr = MEVEL_ERR_NONE;
+        }
+
+        if (cbr != MEVEL_ERR_NONE || (what & MEVEL_HUP))
+        {
+            mevel_del(ctx, ev);
+            return (cbr != MEVEL_ERR_NONE) ? cbr : MEVEL_ERR_CLOSE;
+        }
+
+        what = mevel_conn_snd(ev);
+    }
+
+    // a close waits for the zero-copy completions too, or their buffers could not be released
+    if ((conn->state & MEVEL_CN_SHUT) && ring_len(&conn->out) == 0 && conn->jobs == NULL && conn->zcs == NULL)
+    {
+        mevel_del(ctx, ev);
+        return MEVEL_ERR_CLOSE;
+    }
+
+    // multi-threaded and io_uring events are re-armed with the new mask by the loop
+    mevel_conn_mod(ctx, ev, !(ctx->flags & MEVEL_CTX_MT) && ctx->uring == NULL);
+
+    return (conn->state & MEVEL_CN_MORE) ? MEVEL_ERR_AGAIN : MEVEL_ERR_NONE;
+}
+
+// receives batches until the socket runs dry or the round budget is used up;
+// replies queued by the callback leave with one sendmmsg per batch
+static mevel_err_t mevel_run_dgram(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    mevel_dgram_t*  dgram   = ev->dgram;
+    mevel_err_t     cbr     = MEVEL_ERR_NONE;
+    int             round   = 0;
+
+    for (; round < MEVEL_DGRAM_ROUNDS; round++)
+    {
+        int cnt = mmsg_rcv(&dgram->in, ev->fd);
+
+        if (cnt < 0 && errno == EINTR) continue;
+        if (cnt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        cbr = ev->cb(ev, (cnt < 0) ? -errno : cnt);
+
+        if (dgram->out.len) mmsg_snd(&dgram->out, ev->fd);
+
+        // a yield leaves the rest to the next report of the level-triggered socket
+        if (cbr == MEVEL_ERR_AGAIN) break;
+
+        if (cbr != MEVEL_ERR_NONE)
+        {
+            mevel_del(ctx, ev);
+            return cbr;
+        }
+
+        // a short batch drained the socket
+        if (cnt < 0 || (unsigned) cnt < dgram->in.count) break;
+    }
+
+    dgram->in.len = 0;
+
+    // every round took a full batch; the socket may hold more
+    return (round == MEVEL_DGRAM_ROUNDS) ? MEVEL_ERR_AGAIN : cbr;
+}
+
+// runs the handler of a ready event of the epoll backend, or of a still-ready one
+static mevel_err_t mevel_run_ev(mevel_ctx_t* ctx, mevel_event_t* ev, int flags)
+{
+    // the listener callback serves the accepted connections, not the listener
+    if (ev->type == MEVEL_TYPE_ACC) mevel_run_acc(ctx, ev);
+    else if (ev->type == MEVEL_TYPE_RCV) return mevel_run_rcv(ctx, ev);
+    else if (ev->type == MEVEL_TYPE_CONN) return mevel_run_conn(ctx, ev, flags);
+    else if (ev->type == MEVEL_TYPE_DGRAM) return mevel_run_dgram(ctx, ev);
+    else if (ev->group) return mevel_run_grp(ctx, ev, flags);
+    else return mevel_dispatch(ctx, ev, flags);
+
+    return MEVEL_ERR_NONE;
+}
+
+static mevel_err_t mevel_uring_arm(mevel_ctx_t* ctx, mevel_event_t* ev);
+
+// hands an event back once its handler returned; an edge-triggered event that
+// yielded with input left is not reported again, so it joins the still-ready
+// list instead, as does a connection whose input waits in its ring; a
+// level-triggered one is simply reported again
+static void mevel_rearm(mevel_ctx_t* ctx, mevel_event_t* ev, int flags, mevel_err_t cbr)
+{
+    // multishot receives of io_uring keep delivering buffers by themselves
+    if (cbr == MEVEL_ERR_AGAIN && ((ev->event.events & EPOLLET) || ev->type == MEVEL_TYPE_CONN) &&
+        !(ctx->uring && ev->type == MEVEL_TYPE_RCV))
+    {
+        mevel_lck(ctx);
+        mevel_rdy_put(ctx, ev, flags);
+        mevel_ulk(ctx);
+        return;
+    }
+
+    if (cbr != MEVEL_ERR_NONE && cbr != MEVEL_ERR_AGAIN) return;
+
+    // new readiness was reported and handled before its still-ready turn came
+    if (ev->state & MEVEL_ST_READY)
+    {
+        mevel_lck(ctx);
+        mevel_rdy_del(ctx, ev);
+        mevel_ulk(ctx);
+    }
+
+    if (ctx->uring)
+    {
+        if (!(ev->state & MEVEL_ST_ARMED)) mevel_uring_arm(ctx, ev);
+    }
+    else if (ctx->flags & MEVEL_CTX_MT)
+    {
+        // hand the one-shot event back to the epoll set
+        epoll_ctl(mevel_epfd(ctx, ev), EPOLL_CTL_MOD, ev->fd, &ev->event);
+    }
+}
+
+// gives the events that yielded so far one more turn each, oldest first;
+// those yielding again go to the back for the next pass
+static void mevel_run_ready(mevel_ctx_t* ctx, uint64_t* stamp)
+{
+    size_t count = __atomic_load_n(&ctx->nready, __ATOMIC_RELAXED);
+
+    for (; count; count--)
+    {
+        mevel_lck(ctx);
+        mevel_event_t* ev = mevel_rdy_get(ctx);
+        mevel_ulk(ctx);
+
+        if (ev == NULL) break;
+
+        int         type    = ev->type;
+        int         fd      = ev->fd;
+        int         flags   = ev->rflags;
+        mevel_err_t cbr     = mevel_run_ev(ctx, ev, flags);
+
+        if (mevel_timed(ctx)) mevel_met_cb(ctx, type, fd, flags, cbr, stamp);
+
+        mevel_rearm(ctx, ev, flags, cbr);
+    }
+}
+
+// orders a batch by class into order, keeping the kernel order within each class
+static void mevel_sort(const epoll_event_t* events, epoll_event_t* order, int nfds)
+{
+    int start[MEVEL_PRIOS + 1] = {0};
+
+    for (int indx = 0; indx < nfds; indx++)
+    {
+        mevel_event_t* ev = (mevel_event_t*) events[indx].data.ptr;
+        start[(ev ? ev->prio : MEVEL_PRIO_HIGH) + 1]++;
+    }
+
+    for (int prio = 1; prio < MEVEL_PRIOS; prio++) start[prio] += start[prio - 1];
+
+    for (int indx = 0; indx < nfds; indx++)
+    {
+        mevel_event_t* ev = (mevel_event_t*) events[indx].data.ptr;
+        order[start[ev ? ev->prio : MEVEL_PRIO_HIGH]++] = events[indx];
+    }
+}
+
+// true for an item whose event was deleted after it was collected; the event
+// is released here unless io_uring still holds it. leave ends the wait for the
+// group handler of a live one too
+static int mevel_grp_dead(mevel_ctx_t* ctx, mevel_event_t* ev, int leave)
+{
+    mevel_lck(ctx);
+
+    int dead = (ev->state & MEVEL_ST_DEAD) != 0;
+
+    if (dead || leave) ev->state &= ~MEVEL_ST_GROUPED;
+    if (dead && !(ev->state & MEVEL_ST_ARMED)) mevel_ev_fre(ctx, ev);
+
+    mevel_ulk(ctx);
+
+    return dead;
+}
+
+// calls every group handler once with its items in their batch order, then
+// handles each result the way a callback result is; an earlier callback or
+// handler may have deleted events of the items meanwhile, which are left out
+static void mevel_run_groups(mevel_ctx_t* ctx, mevel_item_t* items, size_t count, uint64_t* stamp)
+{
+    size_t done = 0;
+
+    while (done < count)
+    {
+        mevel_group_t*  grp  = items[done].group;
+        size_t          end  = done;
+        size_t          live = done;
+
+        // gather the live items of this group in front of the rest
+        for (size_t indx = done; indx < count; indx++)
+        {
+            if (items[indx].group != grp) continue;
+
+            if (mevel_grp_dead(ctx, items[indx].ev, 0))
+            {
+                items[indx] = items[end++];
+                continue;
+            }
+
+            if (indx != live)
+            {
+                mevel_item_t item = items[indx];
+                items[indx] = items[end];
+                items[end]  = items[live];
+                items[live] = item;
+            }
+
+            live++;
+            end++;
+        }
+
+        if (live > done)
+        {
+            grp->fn(ctx, items + done, live - done, grp->arg);
+
+            if (mevel_timed(ctx)) mevel_met_cb(ctx, MEVEL_TYPE_IO, -1, (int)(live - done), MEVEL_ERR_NONE, stamp);
+        }
+
+        for (; done < live; done++)
+        {
+            mevel_item_t* item = &items[done];
+
+            if (mevel_grp_dead(ctx, item->ev, 1)) continue;
+
+            if (item->ret != MEVEL_ERR_NONE && item->ret != MEVEL_ERR_AGAIN) mevel_del(ctx, item->ev);
+
+            mevel_rearm(ctx, item->ev, item->flags, item->ret);
+        }
+
+        done = end;
+    }
+}
+
+// dispatches a batch; events of a group are collected in items, which holds nfds,
+// and handed over at the end of their class so that a sorted batch keeps its order
+static void mevel_run_batch(mevel_ctx_t* ctx, epoll_event_t* events, int nfds, mevel_item_t* items, uint64_t* stamp)
+{
+    size_t count = 0;
+    int    prio  = MEVEL_PRIO_HIGH;
+
+    for (int indx = 0; indx < nfds; indx++)
+    {
+        mevel_event_t* ev = (mevel_event_t*)events[indx].data.ptr;
+
+        if (ev == NULL || events[indx].events == 0) continue;
+
+        if (ev->prio != prio)
+        {
+            if (count) mevel_run_groups(ctx, items, count, stamp);
+
+            count = 0;
+            prio  = ev->prio;
+        }
+
+        if (ev->group != NULL && ev->type == MEVEL_TYPE_IO && ev->fd > 0)
+        {
+            mevel_item_t item = { ev, (int) events[indx].events, MEVEL_ERR_NONE, ev->group };
+            items[count++] = item;
+
+            mevel_lck(ctx);
+            ev->state |= MEVEL_ST_GROUPED;
+            mevel_ulk(ctx);
+        }
+        else if (ev->cb != NULL && ev->fd > 0)
+        {
+            int         type = ev->type;
+            int         fd   = ev->fd;
+            mevel_err_t cbr  = mevel_run_ev(ctx, ev, events[indx].events);
+
+            if (mevel_timed(ctx)) mevel_met_cb(ctx, type, fd, events[indx].events, cbr, stamp);
+
+            mevel_rearm(ctx, ev, events[indx].events, cbr);
+        }
+    }
+
+    if (count) mevel_run_groups(ctx, items, count, stamp);
+}
+
+static mevel_err_t mevel_run_epoll(mevel_ctx_t* ctx)
+{
+    mevel_err_t     ret = MEVEL_ERR_NONE;
+    int nfds            = 0;
+    mevel_batch_t   batch;
+
+    // every thread of a multi-threaded context adapts its own batch
+    mevel_batch_ini(&batch, ctx->nevents, ctx->maxevents);
+
+    // the second half takes the high set and the batch ordered by class
+    epoll_event_t*  events = (epoll_event_t*) malloc(2 * batch.max * sizeof(epoll_event_t));
+    epoll_event_t*  order  = events + batch.max;
+    mevel_item_t*   items  = (mevel_item_t*) malloc(batch.max * sizeof(mevel_item_t));
+
+    if (events == NULL || items == NULL)
+    {
+        free(events);
+        free(items);
+        __atomic_store_n(&ctx->running, 0x00, __ATOMIC_RELEASE);
+        return MEVEL_ERR_WAIT;
+    }
+
+    uint64_t        woke    = mevel_timed(ctx) ? mevel_ns() : 0;
+    uint64_t        stamp   = woke;
+
+    while (__atomic_load_n(&ctx->running, __ATOMIC_ACQUIRE))
+    {
+        mevel_run_hooks(ctx, MEVEL_PHASE_PREP);
+
+        int timeout = mevel_timeout(ctx);
+
+        if (mevel_timed(ctx)) stamp = mevel_met_wait(ctx, woke);
+
+		nfds = epoll_wait(ctx->epollfd, events, batch.size, timeout);
+
+        if (nfds < 0)
+        {
+            // a signal returns this thread only and the context can run again
+            if (errno == EINTR) ret = MEVEL_ERR_HUP;
+            else
+            {
+                ret = MEVEL_ERR_WAIT;
+                __atomic_store_n(&ctx->running, 0x00, __ATOMIC_RELEASE);
+            }
+            break;
+        }
+
+        __atomic_add_fetch(&ctx->stats.waits, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&ctx->stats.events, nfds, __ATOMIC_RELAXED);
+        if (nfds == batch.size) __atomic_add_fetch(&ctx->stats.full, 1, __ATOMIC_RELAXED);
+
+        if (mevel_timed(ctx)) woke = stamp = mevel_met_wake(ctx, stamp, timeout);
+        if (ctx->metrics) mevel_met_add(ctx, &ctx->metrics->batch, nfds);
+
+        // high events are polled ahead of every batch, whether or not they made it into it
+        if (ctx->hifd >= 0)
+        {
+            int nhi = epoll_wait(ctx->hifd, order, batch.size, 0);
+
+            if (nhi > 0)
+            {
+                __atomic_add_fetch(&ctx->stats.events, nhi, __ATOMIC_RELAXED);
+                mevel_run_batch(ctx, order, nhi, items, &stamp);
+            }
+        }
+
+        if (nfds > 1 && __atomic_load_n(&ctx->prios, __ATOMIC_RELAXED))
+        {
+            mevel_sort(events, order, nfds);
+            mevel_run_batch(ctx, order, nfds, items, &stamp);
+        }
+        else mevel_run_batch(ctx, events, nfds, items, &stamp);
+
+        mevel_run_ready(ctx, &stamp);
+
+        int size = batch.size;
+        if (mevel_batch_adj(&batch, nfds) != size)
+        {
+            __atomic_store_n(&ctx->stats.nevents, batch.size, __ATOMIC_RELAXED);
+        }
+
+        mevel_run_timers(ctx);
+        mevel_run_phases(ctx, nfds == 0);
+    }
+
+    free(events);
+    free(items);
+
+    return ret;
+}
+
+static struct io_uring_sqe* mevel_uring_sqe(mevel_ctx_t* ctx)
+{
+    struct io_uring_sqe* sqe = uring_sqe(ctx->uring);
+
+    if (sqe == NULL)
+    {
+        // the submission queue is full; flush it without waiting
+        uring_sub(ctx->uring, 0, 0);
+        sqe = uring_sqe(ctx->uring);
+    }
+
+    return sqe;
+}
+
+static mevel_err_t mevel_uring_arm(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    struct io_uring_sqe* sqe = mevel_uring_sqe(ctx);
+
+    if (sqe == NULL) return MEVEL_ERR_ADD;
+
+    sqe->fd         = ev->fd;
+    sqe->user_data  = (uintptr_t) ev;
+
+    if (ev->type == MEVEL_TYPE_ACC)
+    {
+        sqe->opcode         = IORING_OP_ACCEPT;
+        sqe->ioprio         = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags   = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    }
+    else if (ev->type == MEVEL_TYPE_RCV)
+    {
+        sqe->opcode         = IORING_OP_RECV;
+        sqe->ioprio         = IORING_RECV_MULTISHOT;
+        sqe->flags          = IOSQE_BUFFER_SELECT;
+        sqe->buf_group      = MEVEL_URING_BGID;
+    }
+    else
+    {
+        // edge-triggered interest maps onto a multishot poll; level-triggered
+        // interest is polled once and re-armed after every callback
+        sqe->opcode         = IORING_OP_POLL_ADD;
+        sqe->poll32_events  = ev->event.events & ~(EPOLLET | EPOLLONESHOT);
+        if (ev->event.events & EPOLLET) sqe->len = IORING_POLL_ADD_MULTI;
+    }
+
+    ev->state |= MEVEL_ST_ARMED;
+
+    return MEVEL_ERR_NONE;
+}
+
+// changes the mask of an armed poll in place
+static void mevel_uring_upd(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    struct io_uring_sqe* sqe = mevel_uring_sqe(ctx);
+
+    if (sqe == NULL) return;
+
+    sqe->opcode         = IORING_OP_POLL_REMOVE;
+    sqe->addr           = (uintptr_t) ev;
+    sqe->len            = IORING_POLL_UPDATE_EVENTS;
+    sqe->poll32_events  = ev->event.events & ~(EPOLLET | EPOLLONESHOT);
+}
+
+// collects a completion for the group handler of its event
+static void mevel_uring_grp(mevel_event_t* ev, int flags, mevel_item_t* items, size_t* count)
+{
+    // a multishot poll may complete again before the handler runs
+    if (ev->state & MEVEL_ST_GROUPED)
+    {
+        for (size_t indx = *count; indx--; )
+        {
+            if (items[indx].ev == ev)
+            {
+                items[indx].flags |= flags;
+                break;
+            }
+        }
+    }
+    else
+    {
+        mevel_item_t item = { ev, flags, MEVEL_ERR_NONE, ev->group };
+
+        ev->state |= MEVEL_ST_GROUPED;
+        items[(*count)++] = item;
+    }
+}
+
+// grouped events are collected in items and re-armed once their handler ran
+static void mevel_uring_cqe(mevel_ctx_t* ctx, mevel_event_t* ev, int res, unsigned flags, mevel_item_t* items, size_t* count)
+{
+    mevel_err_t cbr = MEVEL_ERR_NONE;
+
+    if (!(flags & IORING_CQE_F_MORE)) ev->state &= ~MEVEL_ST_ARMED;
+
+    if (ev->state & MEVEL_ST_DEAD)
+    {
+        if (flags & IORING_CQE_F_BUFFER) uring_buf_put(ctx->uring, (unsigned short)(flags >> IORING_CQE_BUFFER_SHIFT));
+        if (!(ev->state & (MEVEL_ST_ARMED | MEVEL_ST_GROUPED))) mevel_ev_fre(ctx, ev);
+        return;
+    }
+
+    int rflags = (res < 0) ? EPOLLERR : res;
+
+    if (ev->type == MEVEL_TYPE_ACC)
+    {
+        if (res >= 0) mevel_acc(ctx, ev, res);
+    }
+    else if (ev->type == MEVEL_TYPE_RCV)
+    {
+        if (flags & IORING_CQE_F_BUFFER)
+        {
+            unsigned short bid = (unsigned short)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+            ev->rbuf = uring_buf(ctx->uring, bid);
+            cbr      = mevel_dispatch(ctx, ev, res);
+            uring_buf_put(ctx->uring, bid);
+        }
+        else if (res != -ENOBUFS)
+        {
+            // end of stream or an error; running out of buffers just re-arms
+            cbr = mevel_dispatch(ctx, ev, res);
+        }
+    }
+    else if (ev->type == MEVEL_TYPE_CONN)
+    {
+        cbr = mevel_run_conn(ctx, ev, rflags);
+    }
+    else if (ev->type == MEVEL_TYPE_DGRAM)
+    {
+        cbr = mevel_run_dgram(ctx, ev);
+    }
+    else if (ev->group)
+    {
+        mevel_uring_grp(ev, rflags, items, count);
+        return;
+    }
+    else
+    {
+        cbr = mevel_dispatch(ctx, ev, rflags);
+    }
+
+    mevel_rearm(ctx, ev, rflags, cbr);
+}
+
+static mevel_err_t mevel_run_uring(mevel_ctx_t* ctx)
+{
+    struct io_uring_cqe*    cqe = NULL;
+    mevel_err_t             ret = MEVEL_ERR_NONE;
+    mevel_item_t*           items   = (mevel_item_t*) malloc(MEVEL_URING_ENTRIES * sizeof(mevel_item_t));
+    size_t                  nitems  = 0;
+
+    if (items == NULL)
+    {
+        __atomic_store_n(&ctx->running, 0x00, __ATOMIC_RELEASE);
+        return MEVEL_ERR_WAIT;
+    }
+
+    uint64_t                woke    = mevel_timed(ctx) ? mevel_ns() : 0;
+    uint64_t                stamp   = woke;
+
+    while (__atomic_load_n(&ctx->running, __ATOMIC_ACQUIRE))
+    {
+        mevel_run_hooks(ctx, MEVEL_PHASE_PREP);
+
+        int timeout = mevel_timeout(ctx);
+
+        if (mevel_timed(ctx)) stamp = mevel_met_wait(ctx, woke);
+
+        // arm requests queued since the last iteration go out with the wait
+        if (uring_sub(ctx->uring, 1, timeout) < 0)
+        {
+            // a signal returns the loop and the context can run again
+            if (errno == EINTR) ret = MEVEL_ERR_HUP;
+            else
+            {
+                ret = MEVEL_ERR_WAIT;
+                __atomic_store_n(&ctx->running, 0x00, __ATOMIC_RELEASE);
+            }
+            break;
+        }
+
+        uint64_t count = 0;
+
+        if (mevel_timed(ctx)) woke = stamp = mevel_met_wake(ctx, stamp, timeout);
+
+        while ((cqe = uring_cqe(ctx->uring)) != NULL)
+        {
+            mevel_event_t*  ev      = (mevel_event_t*)(uintptr_t) cqe->user_data;
+            int             res     = cqe->res;
+            unsigned        flags   = cqe->flags;
+
+            // release the slot first; callbacks may queue new requests
+            uring_cqe_del(ctx->uring);
+
+            if (ev != NULL)
+            {
+                int type = ev->type;
+                int fd   = ev->fd;
+
+                mevel_uring_cqe(ctx, ev, res, flags, items, &nitems);
+                if (mevel_timed(ctx)) mevel_met_cb(ctx, type, fd, res, MEVEL_ERR_NONE, &stamp);
+            }
+            count++;
+
+            if (nitems == MEVEL_URING_ENTRIES)
+            {
+                mevel_run_groups(ctx, items, nitems, &stamp);
+                nitems = 0;
+            }
+        }
+
+        if (nitems)
+        {
+            mevel_run_groups(ctx, items, nitems, &stamp);
+            nitems = 0;
+        }
+
+        mevel_run_ready(ctx, &stamp);
+
+        if (ctx->metrics) mevel_met_add(ctx, &ctx->metrics->batch, count);
+
+        // the completion ring has no batch to size; only the counters apply
+        __atomic_add_fetch(&ctx->stats.waits, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&ctx->stats.events, count, __ATOMIC_RELAXED);
+
+        mevel_run_timers(ctx);
+        mevel_run_phases(ctx, count == 0);
+    }
+
+    free(items);
+
+    return ret;
+}
+
+mevel_err_t mevel_run(mevel_ctx_t* ctx)
+{
+
+    if (ctx == NULL) return MEVEL_ERR_NULL;
+
+    // a stop issued before or while this thread enters the loop is seen either here
+    // or by the loop condition, as mevel_stp clears running after it marks the stop
+    __atomic_store_n(&ctx->running, 0xFF, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ctx->stopping, __ATOMIC_SEQ_CST))
+    {
+        __atomic_store_n(&ctx->running, 0x00, __ATOMIC_RELEASE);
+        return MEVEL_ERR_NONE;
+    }
+
+    if (ctx->uring) return mevel_run_uring(ctx);
+
+    return mevel_run_epoll(ctx);
+}
+
+
+mevel_err_t     mevel_add(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    mevel_err_t     ret = MEVEL_ERR_NULL;
+
+    // events are released into the slab, so only its own are taken
+    if (ev != NULL && !slab_own(ev)) return MEVEL_ERR_ADD;
+
+    if (ctx != NULL && ev != NULL && ev->type == MEVEL_TYPE_TIMER)
+    {
+        // timers live in the wheel; tnode.expire holds the initial timeout until armed
+        mevel_lck(ctx);
+        if (ev->tnode.expire && !wheel_node_linked(&ev->tnode)) wheel_add(ctx->wheel, &ev->tnode, wheel_clk() + ev->tnode.expire);
+        mevel_ev_lnk(ctx, ev);
+        mevel_ulk(ctx);
+        ret = MEVEL_ERR_NONE;
+    }
+    else if (ctx != NULL && ev != NULL && ctx->uring)
+    {
+        ev->state = 0;
+        ret = mevel_uring_arm(ctx, ev);
+        if (ret == MEVEL_ERR_NONE) mevel_ev_lnk(ctx, ev);
+    }
+    else if (ctx != NULL && ev != NULL)
+    {
+        // each event is handled by one thread at a time and re-armed after its callback
+        if (ctx->flags & MEVEL_CTX_MT) ev->event.events |= EPOLLONESHOT;
+
+        ev->event.data.ptr = (void*) ev;
+		if (epoll_ctl(mevel_epfd(ctx, ev), EPOLL_CTL_ADD, ev->fd, &ev->event) < 0)
+		{
+		    ret = MEVEL_ERR_ADD;
+		}
+		else
+		{
+		    mevel_lck(ctx);
+		    mevel_ev_lnk(ctx, ev);
+		    mevel_ulk(ctx);
+		    ret = MEVEL_ERR_NONE;
+		}
+    }
+
+    return ret;
+}
+
+mevel_err_t     mevel_set_prio(mevel_ctx_t* ctx, mevel_event_t* ev, int prio)
+{
+    if (ctx == NULL || ev == NULL || prio < MEVEL_PRIO_HIGH || prio > MEVEL_PRIO_LOW) return MEVEL_ERR_NULL;
+
+    int from = mevel_epfd(ctx, ev);
+    int to   = (prio == MEVEL_PRIO_HIGH && ctx->hifd >= 0) ? ctx->hifd : ctx->epollfd;
+
+    mevel_lck(ctx);
+    int added = ev->prv || ctx->evs == ev;
+    mevel_ulk(ctx);
+
+    if (from != to && added && ev->type != MEVEL_TYPE_TIMER)
+    {
+        // a one-shot event may be running on another thread; moving it would re-arm it
+        if (ctx->flags & MEVEL_CTX_MT) return MEVEL_ERR_ADD;
+
+        if (epoll_ctl(from, EPOLL_CTL_DEL, ev->fd, &ev->event) < 0 ||
+            epoll_ctl(to, EPOLL_CTL_ADD, ev->fd, &ev->event) < 0) return MEVEL_ERR_ADD;
+    }
+
+    ev->prio = prio;
+
+    // the main set mixes classes unless high events have their own
+    if (prio == MEVEL_PRIO_LOW || (prio == MEVEL_PRIO_HIGH && ctx->hifd < 0))
+    {
+        __atomic_store_n(&ctx->prios, 1, __ATOMIC_RELAXED);
+    }
+
+    return MEVEL_ERR_NONE;
+}
+
+mevel_group_t*  mevel_ini_group(mevel_group_fn* fn, void* arg)
+{
+    if (fn == NULL) return NULL;
+
+    mevel_group_t* grp = (mevel_group_t*) malloc(sizeof(mevel_group_t));
+
+    if (grp == NULL) return NULL;
+
+    grp->fn     = fn;
+    grp->arg    = arg;
+
+    return grp;
+}
+
+void    mevel_rel_group(mevel_group_t* grp)
+{
+    free(grp);
+}
+
+mevel_err_t     mevel_set_group(mevel_event_t* ev, mevel_group_t* grp)
+{
+    if (ev == NULL) return MEVEL_ERR_NULL;
+    if (ev->type != MEVEL_TYPE_IO && ev->type != MEVEL_TYPE_ACC) return MEVEL_ERR_FIO;
+
+    ev->group = grp;
+
+    return MEVEL_ERR_NONE;
+}
+
+mevel_err_t     mevel_del(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    mevel_err_t     ret = MEVEL_ERR_NONE;
+
+    // an event the library did not allocate would corrupt the slab
+    if (ev != NULL && !slab_own(ev)) return MEVEL_ERR_DEL;
+
+    // completions run before the event goes and outside the lock
+    if (ev != NULL && ev->conn != NULL) mevel_conn_drop(ev);
+
+    if (ctx != NULL && ev != NULL && ev->type == MEVEL_TYPE_TIMER)
+    {
+        mevel_lck(ctx);
+        wheel_del(ctx->wheel, &ev->tnode);
+        // a timer whose callback is running is released once it returns
+        if (ev->state & MEVEL_ST_FIRING) ev->state |= MEVEL_ST_DEAD;
+        else mevel_ev_fre(ctx, ev);
+        mevel_ulk(ctx);
+    }
+    else if (ctx != NULL && ev != NULL && ctx->uring)
+    {
+        int fd = ev->fd;
+
+        if (ev->state & MEVEL_ST_ARMED)
+        {
+            // the kernel still references the event; release it with the last completion
+            struct io_uring_sqe* sqe = mevel_uring_sqe(ctx);
+            if (sqe)
+            {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr   = (uintptr_t) ev;
+            }
+            // without a cancel the request lives until it completes on its own
+            else ret = MEVEL_ERR_DEL;
+            ev->state |= MEVEL_ST_DEAD;
+            ev->fd     = -1;
+            mevel_rdy_del(ctx, ev);
+        }
+        else if (ev->state & MEVEL_ST_GROUPED)
+        {
+            ev->state |= MEVEL_ST_DEAD;
+            ev->fd     = -1;
+            mevel_rdy_del(ctx, ev);
+        }
+        else mevel_ev_fre(ctx, ev);
+
+        // closed once the cancel is queued: flushing a full queue may still submit requests on it
+        if (fd > 0) close(fd);
+    }
+    else if (ctx != NULL && ev != NULL)
+    {
+		if (epoll_ctl(mevel_epfd(ctx, ev), EPOLL_CTL_DEL, ev->fd, &ev->event) < 0)
+		{
+		    ret = MEVEL_ERR_DEL;
+		}
+
+        if (ev->fd > 0) close(ev->fd);
+        mevel_lck(ctx);
+        // an event waiting for its group handler is released when the group is flushed
+        if (ev->state & MEVEL_ST_GROUPED)
+        {
+            ev->state |= MEVEL_ST_DEAD;
+            ev->fd     = -1;
+            mevel_rdy_del(ctx, ev);
+        }
+        else mevel_ev_fre(ctx, ev);
+        mevel_ulk(ctx);
+    }
+    else ret = MEVEL_ERR_NULL;
+
+    return ret;
+}
+
+
+void    mevel_rel_ev(mevel_event_t* ev)
+{
+    if (ev == NULL || !slab_own(ev)) return;
+
+    mevel_ctx_t* ctx = ev->ctx;
+
+    if (ctx) mevel_lck(ctx);
+    mevel_ev_put(ev);
+    if (ctx) mevel_ulk(ctx);
+}
+
+mevel_event_t*  mevel_ini_fio(mevel_ctx_t* ctx, mevel_cb_t cb, int fd, int evmask)
+{
+    mevel_event_t* ev = mevel_ev_get(ctx);
+
+    if (ev)
+    {
+        ev->ctx             = ctx;
+        ev->data            = NULL;
+        ev->rbuf            = NULL;
+        ev->state           = 0;
+        ev->type            = MEVEL_TYPE_IO;
+        ev->fd              = fd;
+        ev->cb              = cb;
+        ev->event.events    = evmask;
+    }
+
+    return ev;
+}
+
+
+mevel_event_t*  mevel_ini_conn(mevel_ctx_t* ctx, mevel_cb_t cb, int fd, int evmask)
+{
+    if (cb == NULL || fd < 0) return NULL;
+
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    if (flags < 0 || (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)) return NULL;
+
+    mevel_event_t* ev = mevel_ini_fio(ctx, cb, fd, (evmask | MEVEL_READ | MEVEL_RDHUP) & ~MEVEL_WRITE);
+
+    if (ev == NULL) return NULL;
+
+    // the rings are allocated on first use
+    ev->type = MEVEL_TYPE_CONN;
+    ev->conn = (mevel_conn_t*) calloc(1, sizeof(mevel_conn_t));
+
+    if (ev->conn == NULL)
+    {
+        mevel_rel_ev(ev);
+        return NULL;
+    }
+
+    ev->conn->low   = MEVEL_CONN_LOW;
+    ev->conn->high  = MEVEL_CONN_HIGH;
+
+    // epoll drains edge-triggered; io_uring polls once and re-arms after every callback
+    if (ctx && ctx->uring) ev->event.events &= ~EPOLLET;
+    else ev->event.events |= EPOLLET;
+
+    return ev;
+}
+
+size_t  mevel_conn_read(mevel_event_t* ev, void* buf, size_t len)
+{
+    if (ev == NULL || ev->conn == NULL || buf == NULL) return 0;
+
+    return ring_get(&ev->conn->in, buf, len);
+}
+
+mevel_err_t  mevel_conn_write(mevel_event_t* ev, const void* buf, size_t len)
+{
+    if (ev == NULL || ev->conn == NULL || (buf == NULL && len)) return MEVEL_ERR_NULL;
+
+    mevel_conn_t* conn = ev->conn;
+
+    if (conn->out.cap == 0 && ring_ini(&conn->out, (len > MEVEL_CONN_SIZE) ? len : MEVEL_CONN_SIZE) < 0) return MEVEL_ERR_FIO;
+    if (ring_res(&conn->out, len, 0) < 0) return MEVEL_ERR_FIO;
+
+    ring_put(&conn->out, buf, len);
+    conn->queued += len;
+
+    if (ring_len(&conn->out) > conn->high) conn->state |= MEVEL_CN_FULL;
+
+    // nobody waits for EPOLLOUT and no callback is about to flush; send right away
+    if (!(conn->state & MEVEL_CN_BUSY) && !(ev->event.events & EPOLLOUT))
+    {
+        if (mevel_conn_snd(ev) & MEVEL_ERROR) return MEVEL_ERR_HUP;
+        mevel_conn_mod(ev->ctx, ev, 1);
+    }
+
+    return MEVEL_ERR_NONE;
+}
+
+// queues a job behind the output written so far and sends what it can right away
+static mevel_err_t mevel_conn_job(mevel_event_t* ev, struct mevel_job* job)
+{
+    mevel_conn_t* conn = ev->conn;
+
+    job->nxt    = NULL;
+    job->mark   = conn->queued;
+    job->seq    = 0;
+
+    if (conn->last) conn->last->nxt = job;
+    else conn->jobs = job;
+    conn->last = job;
+
+    // the same as for written output; the loop takes over once EPOLLOUT is armed
+    if (!(conn->state & MEVEL_CN_BUSY) && !(ev->event.events & EPOLLOUT))
+    {
+        if (mevel_conn_snd(ev) & MEVEL_ERROR) return MEVEL_ERR_HUP;
+        mevel_conn_mod(ev->ctx, ev, 1);
+    }
+
+    return MEVEL_ERR_NONE;
+}
+
+mevel_err_t  mevel_conn_sendfile(mevel_event_t* ev, int fd, off_t off, size_t len, mevel_sent_fn* done, void* arg)
+{
+    if (ev == NULL || ev->conn == NULL || fd < 0 || off < 0) return MEVEL_ERR_NULL;
+
+    struct mevel_job* job = (struct mevel_job*) malloc(sizeof(struct mevel_job));
+
+    if (job == NULL) return MEVEL_ERR_FIO;
+
+    job->kind   = MEVEL_JOB_FILE;
+    job->fd     = fd;
+    job->off    = off;
+    job->buf    = NULL;
+    job->len    = len;
+    job->done   = done;
+    job->arg    = arg;
+
+    return mevel_conn_job(ev, job);
+}
+
+mevel_err_t  mevel_conn_sendzc(mevel_event_t* ev, const void* buf, size_t len, mevel_sent_fn* done, void* arg)
+{
+    if (ev == NULL || ev->conn == NULL || (buf == NULL && len)) return MEVEL_ERR_NULL;
+
+    struct mevel_job* job = (struct mevel_job*) malloc(sizeof(struct mevel_job));
+
+    if (job == NULL) return MEVEL_ERR_FIO;
+
+    job->kind   = MEVEL_JOB_ZC;
+    job->fd     = -1;
+    job->off    = 0;
+    job->buf    = (const char*) buf;
+    job->len    = len;
+    job->done   = done;
+    job->arg    = arg;
+
+    return mevel_conn_job(ev, job);
+}
+
+mevel_err_t  mevel_conn_close(mevel_event_t* ev)
+{
+    if (ev == NULL || ev->conn == NULL) return MEVEL_ERR_NULL;
+
+    ev->conn->state |= MEVEL_CN_SHUT;
+
+    // the loop closes it from its next EPOLLOUT, never under a pending event
+    if (!(ev->conn->state & MEVEL_CN_BUSY)) mevel_conn_mod(ev->ctx, ev, 1);
+
+    return MEVEL_ERR_NONE;
+}
+
+int     mevel_conn_full(mevel_event_t* ev)
+{
+    return (ev && ev->conn && (ev->conn->state & MEVEL_CN_FULL)) ? 1 : 0;
+}
+
+mevel_err_t  mevel_conn_wmk(mevel_event_t* ev, size_t low, size_t high)
+{
+    if (ev == NULL || ev->conn == NULL) return MEVEL_ERR_NULL;
+    if (low > high) return MEVEL_ERR_FIO;
+
+    ev->conn->low   = low;
+    ev->conn->high  = high;
+
+    return MEVEL_ERR_NONE;
+}
+
+mevel_event_t*  mevel_ini_rcv(mevel_ctx_t* ctx, mevel_cb_t cb, int fd)
+{
+    mevel_event_t* ev = mevel_ini_fio(ctx, cb, fd, MEVEL_READ);
+
+    if (ev) ev->type = MEVEL_TYPE_RCV;
+
+    return ev;
+}
+
+// turns an event into a datagram event; the reply batch is allocated on first use
+static int mevel_dgram_ini(mevel_event_t* ev, unsigned count, size_t size)
+{
+    ev->dgram = (mevel_dgram_t*) calloc(1, sizeof(mevel_dgram_t));
 
-	    if (ctx->epollfd < 0)
-	    {
-	        free(ctx);
-	        ctx = NULL;
-	    }
-    }
+    if (ev->dgram == NULL) return -1;
 
-    if (ctx)
+    if (mmsg_ini(&ev->dgram->in, count ? count : MEVEL_DGRAM_BATCH, size ? size : MEVEL_DGRAM_SIZE) < 0)
     {
-        ctx->qctx = queue_ini();
-        if (ctx->qctx == NULL)
-        {
-	        free(ctx);
-	        ctx = NULL;
-        }
+        free(ev->dgram);
+        ev->dgram = NULL;
+        return -1;
     }
 
+    ev->type            = MEVEL_TYPE_DGRAM;
+    ev->event.events    = MEVEL_READ;
 
-    return ctx;
+    return 0;
 }
 
-void    mevel_rel(mevel_ctx_t* ctx)
+mevel_event_t*  mevel_ini_dgram(mevel_ctx_t* ctx, mevel_cb_t cb, int fd, unsigned count, size_t size)
 {
+    if (cb == NULL || fd < 0) return NULL;
 
-    if (ctx)
-    {
-        queue_rel_ptr(ctx->qctx);
+    mevel_event_t* ev = mevel_ini_fio(ctx, cb, fd, MEVEL_READ);
 
-        if (ctx->epollfd > 0) close(ctx->epollfd);
-        free(ctx);
-        ctx = NULL;
+    if (ev && mevel_dgram_ini(ev, count, size) < 0)
+    {
+        mevel_rel_ev(ev);
+        return NULL;
     }
+
+    return ev;
 }
 
-mevel_err_t mevel_run(mevel_ctx_t* ctx)
+void*   mevel_dgram_data(mevel_event_t* ev, unsigned indx, size_t* len)
 {
+    if (ev == NULL || ev->dgram == NULL) return NULL;
 
-    if (ctx == NULL) return MEVEL_ERR_NULL;
-
-    struct sockaddr_storage     peer;
-    socklen_t                   plen;
+    return mmsg_buf(&ev->dgram->in, indx, len);
+}
 
-    mevel_err_t     ret = MEVEL_ERR_NONE;
-    int nfds            = 0;
-    int timeout         = MEVEL_MAX_TIMEOUT;
-	epoll_event_t  events[MEVEL_MAX_EVENTS];
+const struct sockaddr*  mevel_dgram_peer(mevel_event_t* ev, unsigned indx, socklen_t* alen)
+{
+    if (ev == NULL || ev->dgram == NULL) return NULL;
 
-	ctx->running = 0xFF;
+    return mmsg_addr(&ev->dgram->in, indx, alen);
+}
 
-    while (ctx->running)
-    {
+mevel_err_t  mevel_dgram_send(mevel_event_t* ev, const void* buf, size_t len, const struct sockaddr* addr, socklen_t alen)
+{
+    return mevel_dgram_send_gso(ev, buf, len, 0, addr, alen);
+}
 
-		nfds = epoll_wait(ctx->epollfd, events, MEVEL_MAX_EVENTS, timeout);
+mevel_err_t  mevel_dgram_send_gso(mevel_event_t* ev, const void* buf, size_t len, size_t seg,
+                                  const struct sockaddr* addr, socklen_t alen)
+{
+    if (ev == NULL || ev->dgram == NULL || (buf == NULL && len) || seg > MMSG_MAX) return MEVEL_ERR_NULL;
 
-        if (nfds < 0)
-        {
-            if (errno == EINTR) ret = MEVEL_ERR_HUP;
-            else ret = MEVEL_ERR_WAIT;
-            ctx->running = 0x00;
-            break;
-        }
-        else if (nfds == 0)
-        {
-            continue;
-        }
+    mmsg_t* out = &ev->dgram->out;
 
-        for (int indx = 0; indx < nfds; indx++)
-        {
-            mevel_event_t* ev = (mevel_event_t*)events[indx].data.ptr;
-            if (ev == NULL || events[indx].events == 0) continue;
-            if (ev->cb != NULL && ev->fd > 0)
-            {
-                if (ev->type == MEVEL_TYPE_ACC)
-                {
-                    int fd = accept4(ev->fd, (struct sockaddr*)&peer, &plen, SOCK_NONBLOCK);
-                    if (fd > 0)
-                    {
-                        mevel_add(ctx, mevel_ini_fio(ctx, ev->cb, fd, ev->evmask));
-                    }
-                }
-
-                mevel_err_t cbr = ev->cb(ev, events[indx].events);
-                if (cbr != MEVEL_ERR_NONE)
-                {
-                    mevel_del(ctx, ev);
-                    if (cbr == MEVEL_ERR_CLOSE && ev->fd > 0) close(ev->fd);
-                }
-            }
-        }
-    }
+    if (out->count == 0 && mmsg_ini(out, ev->dgram->in.count, ev->dgram->in.size) < 0) return MEVEL_ERR_UDP;
 
-    return ret;
+    if (mmsg_out(out, ev->fd, buf, len, addr, alen, (unsigned short) seg) < 0) return MEVEL_ERR_UDP;
 
+    return MEVEL_ERR_NONE;
 }
 
+mevel_err_t  mevel_dgram_reply(mevel_event_t* ev, unsigned indx, const void* buf, size_t len)
+{
+    return mevel_dgram_reply_gso(ev, indx, buf, len, 0);
+}
 
-mevel_err_t     mevel_add(mevel_ctx_t* ctx, mevel_event_t* ev)
+mevel_err_t  mevel_dgram_reply_gso(mevel_event_t* ev, unsigned indx, const void* buf, size_t len, size_t seg)
 {
-    mevel_err_t     ret = MEVEL_ERR_NULL;
+    socklen_t               alen = 0;
+    const struct sockaddr*  addr = mevel_dgram_peer(ev, indx, &alen);
 
-    if (ctx != NULL && ev != NULL)
-    {
-        ev->event.data.ptr = (void*) ev;
-		if (epoll_ctl(ctx->epollfd, EPOLL_CTL_ADD, ev->fd, &ev->event) < 0)
-		{
-		    ret = MEVEL_ERR_ADD;
-		}
-		else
-		{
-		    queue_put(ctx->qctx, ev);
-		    ret = MEVEL_ERR_NONE;
-		}
-    }
+    if (addr == NULL) return MEVEL_ERR_NULL;
 
-    return ret;
+    return mevel_dgram_send_gso(ev, buf, len, seg, addr, alen);
 }
 
-mevel_err_t     mevel_del(mevel_ctx_t* ctx, mevel_event_t* ev)
+size_t  mevel_dgram_seg(mevel_event_t* ev, unsigned indx)
 {
-    mevel_err_t     ret = MEVEL_ERR_NONE;
+    if (ev == NULL || ev->dgram == NULL) return 0;
 
-    if (ctx != NULL && ev != NULL)
-    {
-		if (epoll_ctl(ctx->epollfd, EPOLL_CTL_DEL, ev->fd, &ev->event) < 0)
-		{
-		    ret = MEVEL_ERR_DEL;
-		}
+    return mmsg_seg(&ev->dgram->in, indx);
+}
 
-        if (ev->fd > 0) close(ev->fd);
-        queue_del_ptr(ctx->qctx, ev);
-    }
-    else ret = MEVEL_ERR_NULL;
+mevel_err_t  mevel_dgram_gro(mevel_event_t* ev)
+{
+    if (ev == NULL || ev->dgram == NULL) return MEVEL_ERR_NULL;
 
-    return ret;
-}
+    if (mmsg_gro(&ev->dgram->in, ev->fd) < 0) return MEVEL_ERR_UDP;
 
+    return MEVEL_ERR_NONE;
+}
 
-mevel_event_t*  mevel_ini_fio(mevel_ctx_t* ctx, mevel_cb_t cb, int fd, int evmask)
+mevel_err_t  mevel_dgram_flush(mevel_event_t* ev)
 {
-    mevel_event_t* ev = (mevel_event_t*) malloc(sizeof(mevel_event_t));
+    if (ev == NULL || ev->dgram == NULL) return MEVEL_ERR_NULL;
 
-    if (ev)
-    {
-        ev->ctx             = ctx;
-        ev->type            = MEVEL_TYPE_IO;
-        ev->fd              = fd;
-        ev->cb              = cb;
-        ev->event.events    = evmask;
-    }
+    if (ev->dgram->out.len && mmsg_snd(&ev->dgram->out, ev->fd) < 0) return MEVEL_ERR_UDP;
 
-    return ev;
+    return MEVEL_ERR_NONE;
 }
 
-
 mevel_event_t*  mevel_ini_timer(mevel_ctx_t* ctx, mevel_cb_t cb, int timeout, int period)
 {
-    if (cb == NULL) return NULL;
+    if (cb == NULL || timeout < 0 || period < 0) return NULL;
 
-    mevel_event_t* ev = (mevel_event_t*) malloc(sizeof(mevel_event_t));
+    mevel_event_t* ev = mevel_ev_get(ctx);
 
     if (ev)
     {
         ev->ctx             = ctx;
+        ev->data            = NULL;
+        ev->rbuf            = NULL;
+        ev->state           = 0;
         ev->type            = MEVEL_TYPE_TIMER;
         ev->cb              = cb;
-        ev->event.events    = MEVEL_EDGE | MEVEL_READ;
-        ev->fd              = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        ev->event.events    = 0;
+        ev->fd              = -1;
 
-        if (ev->fd > 0)
-        {
-            struct timespec     ts;
-            struct itimerspec   itime;
+        wheel_node_ini(&ev->tnode, ev);
+        ev->tnode.expire    = (uint64_t) timeout;
+        ev->tnode.period    = (uint64_t) period;
+    }
 
-            ts.tv_sec           = timeout / 1000;
-            ts.tv_nsec          = (timeout % 1000) * 1000000;
-            itime.it_value      = ts;
+    return ev;
+}
 
-            ts.tv_sec           = period / 1000;
-            ts.tv_nsec          = (period % 1000) * 1000000;
-            itime.it_interval   = ts;
+mevel_err_t     mevel_set_timer(mevel_ctx_t* ctx, mevel_event_t* ev, int timeout, int period)
+{
+    if (ctx == NULL || ev == NULL) return MEVEL_ERR_NULL;
+    if (ev->type != MEVEL_TYPE_TIMER || timeout < 0 || period < 0) return MEVEL_ERR_TIMER;
 
-            if (timerfd_settime(ev->fd, 0, &itime, NULL) < 0)
-            {
-                close(ev->fd);
-                ev->fd = -1;
-            }
-        }
+    mevel_lck(ctx);
 
-        if (ev->fd < 0)
-        {
-            free(ev);
-            ev = NULL;
-        }
-    }
+    ev->tnode.period = (uint64_t) period;
 
-    return ev;
+    if (timeout > 0) wheel_add(ctx->wheel, &ev->tnode, wheel_clk() + timeout);
+    else wheel_del(ctx->wheel, &ev->tnode);
+
+    mevel_ulk(ctx);
+
+    return MEVEL_ERR_NONE;
 }
 
+mevel_err_t     mevel_clr_timer(mevel_ctx_t* ctx, mevel_event_t* ev)
+{
+    return mevel_set_timer(ctx, ev, 0, 0);
+}
 
-mevel_event_t*  mevel_ini_tcp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const char* straddr, int port, int evmask)
+
+static mevel_event_t*  mevel_ini_lst(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const char* straddr, int port, int evmask, int reuse)
 {
     if (straddr == NULL || cb == NULL || straddr[0] == '\0') return NULL;
 
-    mevel_event_t* ev = (mevel_event_t*) malloc(sizeof(mevel_event_t));
+    mevel_event_t* ev = mevel_ev_get(ctx);
 
     if (ev == NULL) return NULL;
 
     ev->ctx             = ctx;
+    ev->data            = NULL;
+    ev->rbuf            = NULL;
+    ev->state           = 0;
     ev->type            = MEVEL_TYPE_ACC;
     ev->cb              = cb;
     ev->event.events    = MEVEL_READ;
@@ -261,16 +2473,24 @@ mevel_event_t*  mevel_ini_tcp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const
         baddr.sin_port      =   htons(port);
         if (inet_pton(stype, straddr, &baddr.sin_addr) != 1)
         {
-            free(ev);
+            mevel_rel_ev(ev);
             return NULL;
         }
 
         ev->fd              =   socket(stype, SOCK_STREAM, 0);
 
+        // every listener of a loop group binds the same address
+        if (reuse && setsockopt(ev->fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(int)) < 0)
+        {
+            if (ev->fd > 0) close(ev->fd);
+            mevel_rel_ev(ev);
+            return NULL;
+        }
+
         if (bind(ev->fd, (struct sockaddr*) &baddr, sizeof(struct sockaddr_in)) < 0)
         {
             if (ev->fd > 0) close(ev->fd);
-            free(ev);
+            mevel_rel_ev(ev);
             return NULL;
         }
     }
@@ -284,13 +2504,13 @@ mevel_event_t*  mevel_ini_tcp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const
         if (bind(ev->fd, (struct sockaddr*) &baddr, sizeof(struct sockaddr_un)) < 0)
         {
             if (ev->fd > 0) close(ev->fd);
-            free(ev);
+            mevel_rel_ev(ev);
             return NULL;
         }
     }
     else
     {
-        free(ev);
+        mevel_rel_ev(ev);
         return NULL;
     }
 
@@ -302,44 +2522,52 @@ mevel_event_t*  mevel_ini_tcp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const
     if (flags < 0)
     {
         close(ev->fd);
-        free(ev);
+        mevel_rel_ev(ev);
         return NULL;
     }
 
     if (fcntl(ev->fd, F_SETFL, flags | O_NONBLOCK) < 0)
     {
         close(ev->fd);
-        free(ev);
+        mevel_rel_ev(ev);
         return NULL;
     }
 #else // for those who do not support POSIX
     if (ioctl(ev->fd, FIONBIO, &flags) < 0)
     {
         close(ev->fd);
-        free(ev);
+        mevel_rel_ev(ev);
         return NULL;
     }
 #endif
 
-    if (listen(ev->fd, MEVEL_MAX_EVENTS) < 0)
+    if (listen(ev->fd, ctx ? ctx->backlog : SOMAXCONN) < 0)
     {
         close(ev->fd);
-        free(ev);
+        mevel_rel_ev(ev);
         ev = NULL;
     }
 
     return ev;
 }
 
+mevel_event_t*  mevel_ini_tcp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const char* straddr, int port, int evmask)
+{
+    return mevel_ini_lst(ctx, cb, stype, straddr, port, evmask, 0);
+}
+
 mevel_event_t*  mevel_ini_udp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const char* straddr, int port, int evmask)
 {
     if (straddr == NULL || cb == NULL || straddr[0] == '\0') return NULL;
 
-    mevel_event_t* ev = (mevel_event_t*) malloc(sizeof(mevel_event_t));
+    mevel_event_t* ev = mevel_ev_get(ctx);
 
     if (ev == NULL) return NULL;
 
     ev->ctx             = ctx;
+    ev->data            = NULL;
+    ev->rbuf            = NULL;
+    ev->state           = 0;
     ev->type            = MEVEL_TYPE_IO;
     ev->cb              = cb;
     ev->event.events    = evmask;
@@ -352,7 +2580,7 @@ mevel_event_t*  mevel_ini_udp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const
         baddr.sin_port      =   htons(port);
         if (inet_pton(stype, straddr, &baddr.sin_addr) != 1)
         {
-            free(ev);
+            mevel_rel_ev(ev);
             return NULL;
         }
 
@@ -361,7 +2589,7 @@ mevel_event_t*  mevel_ini_udp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const
         if (bind(ev->fd, (struct sockaddr*) &baddr, sizeof(struct sockaddr_in)) < 0)
         {
             if (ev->fd > 0) close(ev->fd);
-            free(ev);
+            mevel_rel_ev(ev);
             return NULL;
         }
     }
@@ -375,13 +2603,13 @@ mevel_event_t*  mevel_ini_udp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const
         if (bind(ev->fd, (struct sockaddr*) &baddr, sizeof(struct sockaddr_un)) < 0)
         {
             if (ev->fd > 0) close(ev->fd);
-            free(ev);
+            mevel_rel_ev(ev);
             return NULL;
         }
     }
     else
     {
-        free(ev);
+        mevel_rel_ev(ev);
         return NULL;
     }
 
@@ -391,13 +2619,16 @@ mevel_event_t*  mevel_ini_udp(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const
 
 mevel_event_t*  mevel_ini_sig(mevel_ctx_t* ctx, mevel_cb_t cb)
 {
-    mevel_event_t* ev = (mevel_event_t*) malloc(sizeof(mevel_event_t));
+    mevel_event_t* ev = mevel_ev_get(ctx);
 
     if (ev == NULL) return NULL;
 
     sigemptyset(&ev->smask);
 
     ev->ctx             = ctx;
+    ev->data            = NULL;
+    ev->rbuf            = NULL;
+    ev->state           = 0;
     ev->type            = MEVEL_TYPE_SIGNAL;
     ev->event.events    = MEVEL_READ;
     ev->cb              = cb;
@@ -410,7 +2641,7 @@ mevel_event_t*  mevel_ini_sig(mevel_ctx_t* ctx, mevel_cb_t cb)
 
     if (ev->fd <= 0)
     {
-        free(ev);
+        mevel_rel_ev(ev);
         ev = NULL;
     }
 
@@ -446,6 +2677,55 @@ mevel_err_t  mevel_add_fio(mevel_ctx_t* ctx, mevel_cb_t cb, int fd, int evmask)
     return mevel_add(ctx, event);
 }
 
+mevel_err_t  mevel_add_rcv(mevel_ctx_t* ctx, mevel_cb_t cb, int fd)
+{
+    mevel_event_t* event = mevel_ini_rcv(ctx, cb, fd);
+    if (!event) return MEVEL_ERR_FIO;
+
+    return mevel_add(ctx, event);
+}
+
+mevel_err_t  mevel_add_conn(mevel_ctx_t* ctx, mevel_cb_t cb, int fd)
+{
+    mevel_event_t* event = mevel_ini_conn(ctx, cb, fd, MEVEL_NONE);
+    if (!event) return MEVEL_ERR_FIO;
+
+    return mevel_add(ctx, event);
+}
+
+mevel_err_t  mevel_add_tcp_conn(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const char* straddr, int port)
+{
+    mevel_event_t* event = mevel_ini_tcp(ctx, cb, stype, straddr, port, MEVEL_NONE);
+    if (!event) return MEVEL_ERR_TCP;
+
+    event->acc = mevel_ini_conn;
+
+    return mevel_add(ctx, event);
+}
+
+mevel_err_t  mevel_add_dgram(mevel_ctx_t* ctx, mevel_cb_t cb, int fd)
+{
+    mevel_event_t* event = mevel_ini_dgram(ctx, cb, fd, 0, 0);
+    if (!event) return MEVEL_ERR_UDP;
+
+    return mevel_add(ctx, event);
+}
+
+mevel_err_t  mevel_add_udp_dgram(mevel_ctx_t* ctx, mevel_cb_t cb, int stype, const char* straddr, int port)
+{
+    mevel_event_t* event = mevel_ini_udp(ctx, cb, stype, straddr, port, MEVEL_READ);
+    if (!event) return MEVEL_ERR_UDP;
+
+    if (mevel_dgram_ini(event, 0, 0) < 0)
+    {
+        close(event->fd);
+        mevel_rel_ev(event);
+        return MEVEL_ERR_UDP;
+    }
+
+    return mevel_add(ctx, event);
+}
+
 mevel_err_t  mevel_add_timer(mevel_ctx_t* ctx, mevel_cb_t cb, int timeout, int period)
 {
     mevel_event_t* event = mevel_ini_timer(ctx, cb, timeout, period);
@@ -494,9 +2774,225 @@ mevel_err_t  mevel_add_sig(mevel_ctx_t* ctx, mevel_cb_t cb, int count, ...)
     if (ret)
     {
         close(event->fd);
-        free(event);
+        mevel_rel_ev(event);
         return ret;
     }
 
     return mevel_add(ctx, event);
 }
+
+mevel_grp_t*  mevel_grp_ini(size_t size, int flags)
+{
+    cpu_set_t   cpus;
+    int         ncpu = 0;
+    int         cpu[CPU_SETSIZE];
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cpus) == 0)
+    {
+        for (int i = 0; i < CPU_SETSIZE; i++)
+        {
+            if (CPU_ISSET(i, &cpus)) cpu[ncpu++] = i;
+        }
+    }
+
+    if (ncpu == 0)
+    {
+        cpu[0] = 0;
+        ncpu   = 1;
+    }
+
+    if (size == 0) size = (size_t) ncpu;
+    if (flags & MEVEL_GRP_CBPF) flags |= MEVEL_GRP_PIN;
+
+    mevel_grp_t* grp = (mevel_grp_t*) malloc(sizeof(mevel_grp_t));
+
+    if (grp == NULL) return NULL;
+
+    grp->size   = size;
+    grp->flags  = flags;
+    grp->loops  = (mevel_loop_t*) calloc(size, sizeof(mevel_loop_t));
+
+    if (grp->loops == NULL)
+    {
+        free(grp);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        grp->loops[i].cpu = (flags & MEVEL_GRP_PIN) ? cpu[i % ncpu] : -1;
+        grp->loops[i].ret = MEVEL_ERR_NONE;
+        grp->loops[i].ctx = mevel_ini();
+
+        if (grp->loops[i].ctx == NULL)
+        {
+            mevel_grp_rel(grp);
+            return NULL;
+        }
+    }
+
+    return grp;
+}
+
+void    mevel_grp_rel(mevel_grp_t* grp)
+{
+    if (grp)
+    {
+        for (size_t i = 0; i < grp->size; i++)
+        {
+            mevel_rel(grp->loops[i].ctx);
+        }
+
+        free(grp->loops);
+        free(grp);
+    }
+}
+
+static void* mevel_grp_thr(void* arg)
+{
+    mevel_loop_t*   loop = (mevel_loop_t*) arg;
+
+    if (loop->cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(loop->cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    }
+
+    loop->ret = mevel_run(loop->ctx);
+
+    return NULL;
+}
+
+mevel_err_t  mevel_grp_run(mevel_grp_t* grp)
+{
+    if (grp == NULL) return MEVEL_ERR_NULL;
+
+    mevel_err_t ret     = MEVEL_ERR_NONE;
+    size_t      started = 0;
+
+    for (; started < grp->size; started++)
+    {
+        mevel_loop_t* loop = &grp->loops[started];
+
+        if (pthread_create(&loop->thread, NULL, mevel_grp_thr, loop) != 0)
+        {
+            ret = MEVEL_ERR_WAIT;
+            mevel_grp_stp(grp);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < started; i++)
+    {
+        pthread_join(grp->loops[i].thread, NULL);
+        if (ret == MEVEL_ERR_NONE) ret = grp->loops[i].ret;
+    }
+
+    return ret;
+}
+
+void    mevel_grp_stp(mevel_grp_t* grp)
+{
+    if (grp == NULL) return;
+
+    for (size_t i = 0; i < grp->size; i++)
+    {
+        mevel_stp(grp->loops[i].ctx);
+    }
+}
+
+// steers a connection to the listener of the loop pinned to the receiving cpu;
+// cpus no loop is pinned to fall back to the receiving cpu modulo the number of loops
+static int mevel_grp_bpf(mevel_grp_t* grp, int fd)
+{
+    struct sock_filter* code = (struct sock_filter*) malloc((2 * grp->size + 3) * sizeof(struct sock_filter));
+
+    if (code == NULL) return -1;
+
+    unsigned short len = 0;
+
+    code[len++] = (struct sock_filter) { BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU };
+
+    for (size_t i = 0; i < grp->size; i++)
+    {
+        uint32_t cpu = (uint32_t) grp->loops[i].cpu;
+        size_t   j   = 0;
+
+        // loops sharing a cpu share its connections through the first of them
+        while (j < i && grp->loops[j].cpu != grp->loops[i].cpu) j++;
+        if (j < i) continue;
+
+        code[len++] = (struct sock_filter) { BPF_JMP | BPF_JEQ | BPF_K, 0, 1, cpu };
+        code[len++] = (struct sock_filter) { BPF_RET | BPF_K,           0, 0, (uint32_t) i };
+    }
+
+    code[len++] = (struct sock_filter) { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t) grp->size };
+    code[len++] = (struct sock_filter) { BPF_RET | BPF_A,           0, 0, 0 };
+
+    struct sock_fprog prog = { len, code };
+
+    int ret = setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+
+    free(code);
+
+    return ret;
+}
+
+mevel_err_t  mevel_grp_add_tcp(mevel_grp_t* grp, mevel_cb_t cb, int stype, const char* straddr, int port, int evmask)
+{
+    if (grp == NULL) return MEVEL_ERR_NULL;
+    if (stype != MEVEL_IPV4 && stype != MEVEL_IPV6) return MEVEL_ERR_TCP;
+
+    mevel_event_t** evs = (mevel_event_t**) calloc(grp->size, sizeof(mevel_event_t*));
+
+    if (evs == NULL) return MEVEL_ERR_TCP;
+
+    mevel_err_t ret   = MEVEL_ERR_NONE;
+    size_t      added = 0;
+
+    // sockets join the reuseport group in bind order; socket i belongs to loop i
+    for (; added < grp->size; added++)
+    {
+        mevel_loop_t*   loop    = &grp->loops[added];
+        mevel_event_t*  ev      = mevel_ini_lst(loop->ctx, cb, stype, straddr, port, evmask, 1);
+
+        if (ev == NULL)
+        {
+            ret = MEVEL_ERR_TCP;
+            break;
+        }
+
+        if (loop->cpu >= 0)
+        {
+            // a hint for kernels that pick the listener by the incoming cpu
+            setsockopt(ev->fd, SOL_SOCKET, SO_INCOMING_CPU, &loop->cpu, sizeof(int));
+        }
+
+        if (mevel_add(loop->ctx, ev) != MEVEL_ERR_NONE)
+        {
+            close(ev->fd);
+            mevel_rel_ev(ev);
+            ret = MEVEL_ERR_TCP;
+            break;
+        }
+
+        evs[added] = ev;
+    }
+
+    if (ret == MEVEL_ERR_NONE && (grp->flags & MEVEL_GRP_CBPF) && mevel_grp_bpf(grp, evs[0]->fd) < 0)
+    {
+        ret = MEVEL_ERR_TCP;
+    }
+
+    // a partial group would leave the address served by some loops only
+    if (ret != MEVEL_ERR_NONE)
+    {
+        for (size_t i = 0; i < added; i++) mevel_del(grp->loops[i].ctx, evs[i]);
+    }
+
+    free(evs);
+
+    return ret;
+}
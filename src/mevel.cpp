@@ -16,28 +16,145 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/timerfd.h>
 #include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <signal.h>
 #include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <time.h>
 
 #include <stdexcept>
 #include <initializer_list>
+#include <vector>
+#include <algorithm>
 
 #include <mevel.h>
 
 namespace mevel
 {
 
-mevel::mevel()
+// binds a datagram socket; returns the descriptor or -1
+static int udp_socket(int stype, const char* straddr, int port)
+{
+    int fd = -1;
+
+    if (stype == MEVEL_IPV4 || stype == MEVEL_IPV6)
+    {
+        struct sockaddr_in  baddr;
+        memset(&baddr, 0x00, sizeof(struct sockaddr_in));
+        baddr.sin_family    =   stype;
+        baddr.sin_port      =   htons(port);
+        if (inet_pton(stype, straddr, &baddr.sin_addr) != 1)
+        {
+            return -1;
+        }
+
+        fd                  =   socket(stype, SOCK_DGRAM, 0);
+
+        if (bind(fd, (struct sockaddr*) &baddr, sizeof(struct sockaddr_in)) < 0)
+        {
+            if (fd > 0) ::close(fd);
+            return -1;
+        }
+    }
+    else if (stype == MEVEL_UNIX)
+    {
+        struct sockaddr_un  baddr;
+        baddr.sun_family = AF_UNIX;
+        strncpy(baddr.sun_path, straddr, sizeof(baddr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+        if (bind(fd, (struct sockaddr*) &baddr, sizeof(struct sockaddr_un)) < 0)
+        {
+            if (fd > 0) ::close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+dgram_t::dgram_t()
+{
+    memset(&in, 0x00, sizeof(mmsg_t));
+    memset(&out, 0x00, sizeof(mmsg_t));
+}
+
+dgram_t::~dgram_t()
+{
+    mmsg_rel(&in);
+    mmsg_rel(&out);
+}
+
+void* mevent::data(unsigned indx, size_t& len) const
+{
+    return dgram ? mmsg_buf(&dgram->in, indx, &len) : nullptr;
+}
+
+const sockaddr* mevent::peer(unsigned indx, socklen_t& alen) const
+{
+    return dgram ? mmsg_addr(&dgram->in, indx, &alen) : nullptr;
+}
+
+bool mevent::send(const void* buf, size_t len, const sockaddr* addr, socklen_t alen, size_t seg) const
+{
+    if (!dgram || (buf == nullptr && len) || seg > MMSG_MAX) return false;
+
+    mmsg_t& out = dgram->out;
+
+    if (out.count == 0 && mmsg_ini(&out, dgram->in.count, dgram->in.size) < 0) return false;
+
+    return mmsg_out(&out, fd, buf, len, addr, alen, static_cast<unsigned short>(seg)) == 0;
+}
+
+bool mevent::reply(unsigned indx, const void* buf, size_t len, size_t seg) const
+{
+    socklen_t       alen = 0;
+    const sockaddr* addr = peer(indx, alen);
+
+    return addr && send(buf, len, addr, alen, seg);
+}
+
+size_t mevent::segment(unsigned indx) const
+{
+    return dgram ? mmsg_seg(&dgram->in, indx) : 0;
+}
+
+bool mevent::flush() const
+{
+    if (!dgram) return false;
+
+    return dgram->out.len == 0 || mmsg_snd(&dgram->out, fd) >= 0;
+}
+
+mevel::mevel(int nevents, int maxevents, int backlog, int accepts)
 : epollfd(0)
+, hifd(-1)
+, prios(false)
 , running(0)
-, eventmap()
+, stopping(0)
+, fdmap()
+, timers()
+, timerids()
+, retired()
 , error_flag(MEVEL_ERR_NONE)
+, wheel(nullptr)
+, batch()
+, backlog(backlog > 0 ? backlog : SOMAXCONN)
+, accepts(accepts > 0 ? accepts : MEVEL_MAX_ACCEPTS)
+, stats()
+, postfd(-1)
+, hookids(0)
+, idle(0)
+, hooking(false)
+, dead(false)
 {
+    mevel_batch_ini(&batch, nevents, maxevents);
+    stats.nevents = batch.size;
+
     epollfd = epoll_create1(EPOLL_CLOEXEC);
 
     if (epollfd < 0)
@@ -46,12 +163,47 @@ mevel::mevel()
         throw exception("epoll_create1(EPOLL_CLOEXEC) failed.", MEVEL_ERR_CONSTRUCTOR);
     }
 
+    wheel = wheel_ini(wheel_clk());
+
+    if (wheel == nullptr)
+    {
+        ::close(epollfd);
+        throw exception("wheel_ini() failed.", MEVEL_ERR_CONSTRUCTOR);
+    }
+
     ev_signal.fd = -1;
+
+    mpsc_ini(&posts);
+    mpsc_ini(&defers);
+
+    postfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (postfd < 0 || !add_fio([this](const mevent&, int) { run_posts(); return MEVEL_ERR_NONE; }, postfd, MEVEL_READ))
+    {
+        if (postfd >= 0) ::close(postfd);
+        ::close(epollfd);
+        wheel_rel(wheel);
+        throw exception("eventfd() failed.", MEVEL_ERR_CONSTRUCTOR);
+    }
 }
 
 mevel::~mevel() noexcept
 {
+    for (mpsc_t* list : {&posts, &defers})
+    {
+        for (mpsc_node_t* node = mpsc_get(list); node != nullptr; )
+        {
+            mpsc_node_t* nxt = node->nxt;
+            delete static_cast<post_t*>(node->ptr);
+            node = nxt;
+        }
+    }
+
+    if (postfd >= 0) ::close(postfd);
     if (epollfd > 0) ::close(epollfd);
+    if (hifd >= 0) ::close(hifd);
+    wheel_rel(wheel);
+    if (trace) trace_rel(trace.get());
 }
 
 void mevel::clear_error_flag()
@@ -64,95 +216,644 @@ error_en mevel::get_error_flag()
     return error_flag;
 }
 
-bool mevel::run()
+mevel_stats_t mevel::get_stats() const
+{
+    return stats;
+}
+
+static inline uint64_t mevel_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+bool mevel::enable_prio()
+{
+    if (hifd >= 0) return true;
+
+    // the high set wakes the main one; its entry carries no event
+    epoll_event hev = {};
+    hev.events = EPOLLIN;
+
+    hifd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (hifd < 0 || epoll_ctl(epollfd, EPOLL_CTL_ADD, hifd, &hev) < 0)
+    {
+        if (hifd >= 0) ::close(hifd);
+        hifd = -1;
+        return false;
+    }
+
+    // high events registered so far move over
+    for (auto& ptr : fdmap)
+    {
+        if (!ptr || ptr->prio != MEVEL_PRIO_HIGH) continue;
+
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, ptr->fd, &ptr->event);
+        epoll_ctl(hifd, EPOLL_CTL_ADD, ptr->fd, &ptr->event);
+    }
+
+    return true;
+}
+
+bool mevel::set_prio(int fd, int prio)
+{
+    clear_error_flag();
+
+    mevent* ptr = find(fd);
+
+    if (ptr == nullptr || prio < MEVEL_PRIO_HIGH || prio > MEVEL_PRIO_LOW)
+    {
+        error_flag = MEVEL_ERR_NULL;
+        return false;
+    }
+
+    int from = epfd(*ptr);
+    int to   = (prio == MEVEL_PRIO_HIGH && hifd >= 0) ? hifd : epollfd;
+
+    if (from != to && fd >= 0)
+    {
+        if (epoll_ctl(from, EPOLL_CTL_DEL, fd, &ptr->event) < 0 ||
+            epoll_ctl(to, EPOLL_CTL_ADD, fd, &ptr->event) < 0)
+        {
+            error_flag = MEVEL_ERR_ADD;
+            return false;
+        }
+    }
+
+    ptr->prio = prio;
+
+    // the main set mixes classes unless high events have their own
+    if (prio == MEVEL_PRIO_LOW || (prio == MEVEL_PRIO_HIGH && hifd < 0)) prios = true;
+
+    return true;
+}
+
+int mevel::epfd(const mevent& ev) const
+{
+    return (ev.prio == MEVEL_PRIO_HIGH && hifd >= 0) ? hifd : epollfd;
+}
+
+bool mevel::enable_metrics()
+{
+    if (!metrics)
+    {
+        metrics.reset(new (std::nothrow) mevel_metrics_t());
+    }
+
+    return metrics != nullptr;
+}
+
+bool mevel::get_metrics(mevel_metrics_t& snap) const
+{
+    if (!metrics) return false;
+
+    for (int type = 0; type < MEVEL_TYPES; type++) hist_get(&metrics->cb[type], &snap.cb[type]);
+
+    hist_get(&metrics->batch, &snap.batch);
+    hist_get(&metrics->lag, &snap.lag);
+
+    snap.wait_ns = __atomic_load_n(&metrics->wait_ns, __ATOMIC_RELAXED);
+    snap.busy_ns = __atomic_load_n(&metrics->busy_ns, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+bool mevel::enable_trace(size_t size)
+{
+    if (!trace)
+    {
+        std::unique_ptr<trace_t> ring(new (std::nothrow) trace_t());
+
+        if (!ring || trace_ini(ring.get(), size ? size : MEVEL_TRACE_SIZE) < 0) return false;
+
+        trace = std::move(ring);
+    }
+
+    return true;
+}
+
+size_t mevel::get_trace(trace_rec_t* out, size_t max) const
+{
+    return trace ? trace_get(trace.get(), out, max) : 0;
+}
+
+bool mevel::dump_trace(int fd) const
+{
+    return trace && trace_dump(trace.get(), fd) == 0;
+}
+
+// the loop is the only writer; relaxed stores keep concurrent snapshots well defined
+void mevel::metric(hist_t* hist, uint64_t val)
 {
+    hist_add(hist, val);
+}
+
+void mevel::metric(uint64_t* sum, uint64_t val)
+{
+    __atomic_store_n(sum, __atomic_load_n(sum, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+}
+
+void mevel::record(int type, int fd, int flags, int err, uint64_t start, uint64_t end)
+{
+    static thread_local uint32_t tid = static_cast<uint32_t>(syscall(SYS_gettid));
+
+    trace_rec_t rec;
 
-    struct sockaddr_storage     peer;
-    socklen_t                   plen;
-	epoll_event                 events[MEVEL_MAX_EVENTS];
+    rec.seq     = 0;
+    rec.start   = start;
+    rec.end     = end;
+    rec.fd      = fd;
+    rec.flags   = static_cast<uint32_t>(flags);
+    rec.tid     = tid;
+    rec.type    = static_cast<uint16_t>(type);
+    rec.err     = static_cast<int16_t>(err);
+
+    trace_add(trace.get(), &rec);
+}
+
+bool mevel::run()
+{
+    std::vector<epoll_event>    events(batch.max);
+    std::vector<epoll_event>    order(batch.max);   // the high set and the batch ordered by class
 
     int nfds            = 0;
     int timeout         = MEVEL_MAX_TIMEOUT;
-	running             = 0xFF;
+    bool timed          = metrics || trace;
+    uint64_t woke       = timed ? mevel_ns() : 0;
+    uint64_t stamp      = woke;
+
+    // a stop issued before or while run is entered is seen either here or by the
+    // loop condition, as stop clears running after it marks the stop
+    __atomic_store_n(&running, 0xFF, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&stopping, __ATOMIC_SEQ_CST))
+    {
+        __atomic_store_n(&running, 0x00, __ATOMIC_RELEASE);
+        return true;
+    }
 
-    while (running != 0x00)
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE))
     {
+        timed = metrics || trace;
+
+        run_hooks(MEVEL_PHASE_PREP);
+
+        // sleep until the nearest timer deadline; pending deferred tasks, idle hooks
+        // and still-ready events only poll
+        timeout = wheel_nxt(wheel, wheel_clk());
+        if (timeout < 0 || timeout > MEVEL_MAX_TIMEOUT) timeout = MEVEL_MAX_TIMEOUT;
+        if (idle || defers.head || !ready.empty()) timeout = 0;
+
+        if (timed)
+        {
+            stamp = mevel_ns();
+            if (metrics) metric(&metrics->busy_ns, stamp - woke);
+        }
 
-		nfds = epoll_wait(epollfd, events, MEVEL_MAX_EVENTS, timeout);
+		nfds = epoll_wait(epollfd, events.data(), batch.size, timeout);
 
         if (nfds < 0)
         {
-            if (errno == EINTR) error_flag = MEVEL_ERR_HUP;
-            else error_flag = MEVEL_ERR_WAIT;
-            running = 0x00;
+            // the loop can be run again after either
+            error_flag = (errno == EINTR) ? MEVEL_ERR_HUP : MEVEL_ERR_WAIT;
+            __atomic_store_n(&running, 0x00, __ATOMIC_RELEASE);
             return false;
         }
-        else if (nfds == 0)
+
+        stats.waits++;
+        stats.events += nfds;
+        if (nfds == batch.size) stats.full++;
+
+        if (timed)
+        {
+            woke = mevel_ns();
+
+            if (metrics)
+            {
+                metric(&metrics->wait_ns, woke - stamp);
+                metric(&metrics->batch, nfds);
+            }
+
+            if (trace) record(TRACE_WAIT, -1, timeout, MEVEL_ERR_NONE, stamp, woke);
+            stamp = woke;
+        }
+
+        // high events are polled ahead of every batch, whether or not they made it into it
+        if (hifd >= 0)
         {
-            continue;
+            int nhi = epoll_wait(hifd, order.data(), batch.size, 0);
+
+            if (nhi > 0)
+            {
+                stats.events += nhi;
+                run_batch(order.data(), nhi, stamp, timed);
+            }
         }
 
-        for (int indx = 0; indx < nfds; indx++)
+        if (prios && nfds > 1)
         {
-            int fd = (int)events[indx].data.fd;
-            mevent& ev = eventmap[fd];
-            if (events[indx].events == 0) continue;
-            if (ev.cb && ev.fd > 0)
+            // counting sort by class; the kernel order stays within each class
+            int start[MEVEL_PRIOS + 1] = {};
+
+            for (int indx = 0; indx < nfds; indx++)
+            {
+                const mevent* ev = static_cast<const mevent*>(events[indx].data.ptr);
+                start[(ev ? ev->prio : MEVEL_PRIO_HIGH) + 1]++;
+            }
+
+            for (int prio = 1; prio < MEVEL_PRIOS; prio++) start[prio] += start[prio - 1];
+
+            for (int indx = 0; indx < nfds; indx++)
             {
-                if (ev.type == MEVEL_TYPE_ACC)
-                {
-                    fd = accept4(ev.fd, (struct sockaddr*)&peer, &plen, SOCK_NONBLOCK);
-                    if (fd > 0)
-                    {
-                        add_fio(ev.cb, fd, ev.evmask);
-                    }
-                }
-                if (ev.cb(ev, events[indx].events) != MEVEL_ERR_NONE)
-                {
-                    del(ev);
-                }
+                const mevent* ev = static_cast<const mevent*>(events[indx].data.ptr);
+                order[start[ev ? ev->prio : MEVEL_PRIO_HIGH]++] = events[indx];
             }
+
+            run_batch(order.data(), nfds, stamp, timed);
         }
+        else run_batch(events.data(), nfds, stamp, timed);
 
+        if (!ready.empty()) run_ready(stamp, timed);
+
+        stats.nevents = mevel_batch_adj(&batch, nfds);
+
+        run_timers();
+        if (defers.head) run_list(mpsc_get(&defers));
+        run_hooks(MEVEL_PHASE_CHECK);
+        if (nfds == 0) run_hooks(MEVEL_PHASE_IDLE);
+        retired.clear();
     }
     return true;
 }
 
-bool mevel::add(mevent ev)
+void mevel::stop()
+{
+    uint64_t one = 1;
+
+    __atomic_store_n(&stopping, 0xFF, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&running, 0x00, __ATOMIC_SEQ_CST);
+
+    if (::write(postfd, &one, sizeof(uint64_t)) < 0) { /* counter saturated; already readable */ }
+}
+
+bool mevel::push(post_t* post)
+{
+    // only the post that finds the list empty wakes the loop; the rest ride along
+    if (mpsc_put(&posts, &post->node))
+    {
+        uint64_t one = 1;
+        if (::write(postfd, &one, sizeof(uint64_t)) < 0) { /* counter saturated; already readable */ }
+    }
+
+    return true;
+}
+
+void mevel::run_posts()
+{
+    uint64_t count;
+
+    // a stop leaves the counter set; the loop is about to return anyway
+    if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) return;
+
+    // reset the counter before taking the list so no post is missed
+    if (::read(postfd, &count, sizeof(uint64_t)) < 0) { /* spurious wakeup */ }
+
+    run_list(mpsc_get(&posts));
+}
+
+void mevel::run_list(mpsc_node_t* node)
+{
+    while (node != nullptr)
+    {
+        post_t* post = static_cast<post_t*>(node->ptr);
+
+        node = node->nxt;
+        post->run();
+        delete post;
+    }
+}
+
+bool mevel::push_defer(post_t* post)
+{
+    // deferred from the loop thread, which does not block while the list is non-empty
+    mpsc_put(&defers, &post->node);
+
+    return true;
+}
+
+hookid_t mevel::push_hook(int phase, post_t* post)
+{
+    if (phase < 0 || phase >= MEVEL_PHASES)
+    {
+        delete post;
+        return 0;
+    }
+
+    hooks[phase].push_back(hook_t{++hookids, std::unique_ptr<post_t>(post)});
+    if (phase == MEVEL_PHASE_IDLE) idle++;
+
+    return hookids;
+}
+
+bool mevel::del_hook(hookid_t id)
+{
+    for (int phase = 0; phase < MEVEL_PHASES; phase++)
+    {
+        for (auto it = hooks[phase].begin(); it != hooks[phase].end(); ++it)
+        {
+            if (it->id != id || id == 0) continue;
+
+            if (phase == MEVEL_PHASE_IDLE) idle--;
+
+            // a walk in progress may be running this very hook; it is swept afterwards
+            if (hooking)
+            {
+                it->id  = 0;
+                dead    = true;
+            }
+            else hooks[phase].erase(it);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void mevel::run_hooks(int phase)
+{
+    std::vector<hook_t>& list = hooks[phase];
+
+    if (list.empty()) return;
+
+    hooking = true;
+
+    // hooks added meanwhile run from the next iteration on; the vector may grow
+    // under a running hook, so it is indexed rather than iterated
+    for (size_t indx = 0, size = list.size(); indx < size; indx++)
+    {
+        if (list[indx].id) list[indx].fn->run();
+    }
+
+    hooking = false;
+
+    if (!dead) return;
+
+    dead = false;
+
+    for (std::vector<hook_t>& hks : hooks)
+    {
+        hks.erase(std::remove_if(hks.begin(), hks.end(), [](const hook_t& hook) { return hook.id == 0; }), hks.end());
+    }
+}
+
+void mevel::run_accept(const mevent& lst)
+{
+    // drain up to the per-iteration budget; the level-triggered listener reports the rest
+    for (int count = 0; count < accepts; count++)
+    {
+        int fd = accept4(lst.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd >= 0)
+        {
+            if (!add_fio(lst.cb.clone(), fd, lst.evmask)) ::close(fd);
+            else if (lst.prio != MEVEL_PRIO_NORMAL) set_prio(fd, lst.prio);
+        }
+        else if (errno != EINTR && errno != ECONNABORTED)
+        {
+            break;
+        }
+    }
+}
+
+error_en mevel::run_dgram(mevent& ev)
+{
+    dgram_t&    dgram   = *ev.dgram;
+    error_en    cbr     = MEVEL_ERR_NONE;
+    int         round   = 0;
+
+    // a short batch drained the socket; full ones are followed up to the round budget
+    for (; round < MEVEL_DGRAM_ROUNDS; round++)
+    {
+        int cnt = mmsg_rcv(&dgram.in, ev.fd);
+
+        if (cnt < 0 && errno == EINTR) continue;
+        if (cnt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        cbr = ev.cb(ev, (cnt < 0) ? -errno : cnt);
+
+        if (dgram.out.len) mmsg_snd(&dgram.out, ev.fd);
+
+        // a yield leaves the rest to the next report of the level-triggered socket
+        if (cbr == MEVEL_ERR_AGAIN) break;
+
+        // a deleted event stays retired until the iteration ends
+        if (cbr != MEVEL_ERR_NONE)
+        {
+            del(ev);
+            break;
+        }
+
+        if (ev.fd < 0 || cnt < 0 || static_cast<unsigned>(cnt) < dgram.in.count) break;
+    }
+
+    dgram.in.len = 0;
+
+    // every round took a full batch; the socket may hold more
+    return (round == MEVEL_DGRAM_ROUNDS) ? MEVEL_ERR_AGAIN : cbr;
+}
+
+void mevel::run_batch(const epoll_event* events, int nfds, uint64_t& stamp, bool timed)
+{
+    for (int indx = 0; indx < nfds; indx++)
+    {
+        // events deleted earlier in this batch are retired with a negative fd
+        mevent* ev = static_cast<mevent*>(events[indx].data.ptr);
+        if (ev == nullptr || events[indx].events == 0) continue;
+        if (ev->cb && ev->fd > 0)
+        {
+            int         type    = ev->type;
+            int         fd      = ev->fd;
+            error_en    cbr     = run_event(*ev, events[indx].events);
+
+            if (timed)
+            {
+                uint64_t now = mevel_ns();
+                if (metrics) metric(&metrics->cb[type - MEVEL_TYPE_IO], now - stamp);
+                if (trace) record(type, fd, events[indx].events, cbr, stamp, now);
+                stamp = now;
+            }
+        }
+    }
+}
+
+error_en mevel::run_event(mevent& ev, int flags)
+{
+    error_en cbr = MEVEL_ERR_NONE;
+
+    // the listener callback serves the accepted connections, not the listener
+    if (ev.type == MEVEL_TYPE_ACC) run_accept(ev);
+    else if (ev.type == MEVEL_TYPE_DGRAM) cbr = run_dgram(ev);
+    else if ((cbr = ev.cb(ev, flags)) != MEVEL_ERR_NONE && cbr != MEVEL_ERR_AGAIN) del(ev);
+
+    // an edge-triggered event that yielded is not reported again, so it gets
+    // another turn after the batch; a level-triggered one simply is
+    if (cbr == MEVEL_ERR_AGAIN && ev.fd > 0 && (ev.event.events & EPOLLET))
+    {
+        if (!ev.ready) ready.push_back(ev.fd);
+        ev.ready    = true;
+        ev.rflags   = flags;
+    }
+    else if (cbr == MEVEL_ERR_NONE || cbr == MEVEL_ERR_AGAIN)
+    {
+        // new readiness was handled before its still-ready turn came
+        ev.ready    = false;
+    }
+
+    return cbr;
+}
+
+void mevel::run_ready(uint64_t& stamp, bool timed)
+{
+    // events yielding again queue up behind this pass for the next one
+    turn.swap(ready);
+
+    for (int fd : turn)
+    {
+        mevent* ev = find(fd);
+
+        if (ev == nullptr || !ev->ready) continue;
+
+        int         type    = ev->type;
+        int         flags   = ev->rflags;
+
+        ev->ready = false;
+
+        error_en    cbr     = run_event(*ev, flags);
+
+        if (timed)
+        {
+            uint64_t now = mevel_ns();
+            if (metrics) metric(&metrics->cb[type - MEVEL_TYPE_IO], now - stamp);
+            if (trace) record(type, fd, flags, cbr, stamp, now);
+            stamp = now;
+        }
+    }
+
+    turn.clear();
+}
+
+void mevel::run_timers()
+{
+    uint64_t        now     = wheel_clk();
+    wheel_node_t*   node    = nullptr;
+
+    while ((node = wheel_pop(wheel, now)) != nullptr)
+    {
+        mevent&     ev  = *static_cast<mevent*>(node->ptr);
+        uint64_t    exp = 1;
+
+        if (node->period) exp += (now - node->expire) / node->period;
+
+        uint64_t    nxt = node->expire + exp * node->period;
+        uint64_t    stamp = 0;
+
+        int         fd  = ev.fd;
+
+        if (metrics || trace) stamp = mevel_ns();
+
+        if (metrics)
+        {
+            metric(&metrics->lag, (stamp > node->expire * 1000000) ? stamp - node->expire * 1000000 : 0);
+        }
+
+        // the callback may reschedule or cancel the timer itself
+        error_en    cbr = ev.cb(ev, static_cast<int>(exp));
+
+        if (metrics || trace)
+        {
+            uint64_t now = mevel_ns();
+            if (metrics) metric(&metrics->cb[MEVEL_TYPE_TIMER - MEVEL_TYPE_IO], now - stamp);
+            if (trace) record(MEVEL_TYPE_TIMER, fd, static_cast<int>(exp), cbr, stamp, now);
+        }
+
+        if (cbr != MEVEL_ERR_NONE && cbr != MEVEL_ERR_AGAIN)
+        {
+            del(ev);
+        }
+        else if (node->period && !wheel_node_linked(node))
+        {
+            wheel_add(wheel, node, nxt);
+        }
+    }
+}
+
+mevent* mevel::find(int fd) const
+{
+    if (fd >= 0) return (static_cast<size_t>(fd) < fdmap.size()) ? fdmap[fd].get() : nullptr;
+
+    size_t id = static_cast<size_t>(-(fd + 1));
+    return (id < timers.size()) ? timers[id].get() : nullptr;
+}
+
+bool mevel::add(mevent&& ev)
 {
     clear_error_flag();
 
-    if (ev.fd < 0 || eventmap.find(ev.fd) != eventmap.end())
+    if (ev.fd < 0 || find(ev.fd) != nullptr)
     {
         error_flag = MEVEL_ERR_ADD;
         return false;
     }
 
-    ev.event.data.fd = ev.fd;
+    if (static_cast<size_t>(ev.fd) >= fdmap.size()) fdmap.resize(ev.fd + 1);
+
+    std::unique_ptr<mevent> ptr(new mevent(std::move(ev)));
+    ptr->event.data.ptr = ptr.get();
 
-    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, ev.fd, &ev.event) < 0)
+    if (epoll_ctl(epfd(*ptr), EPOLL_CTL_ADD, ptr->fd, &ptr->event) < 0)
     {
         error_flag = MEVEL_ERR_ADD;
         return false;
     }
 
-    eventmap.insert(std::make_pair(ev.fd, ev));
+    fdmap[ptr->fd] = std::move(ptr);
 
     return true;
 }
 
-bool mevel::del(mevent& ev)
+bool mevel::del(const mevent& ev)
 {
     clear_error_flag();
 
-    if (eventmap.find(ev.fd) == eventmap.end() || eventmap.erase(ev.fd) != 1)
+    mevent* ptr = find(ev.fd);
+
+    if (ptr == nullptr)
     {
         error_flag = MEVEL_ERR_DEL;
+        return false;
+    }
+
+    // the event may still be referenced by the current batch; keep it until the iteration ends
+    if (ptr->type == MEVEL_TYPE_TIMER)
+    {
+        int id = -(ptr->fd + 1);
+
+        wheel_del(wheel, &ptr->tnode);
+        retired.push_back(std::move(timers[id]));
+        timerids.push_back(id);
     }
-    else if (epoll_ctl(epollfd, EPOLL_CTL_DEL, ev.fd, &ev.event) < 0)
+    else
     {
-        error_flag = MEVEL_ERR_DEL;
+        if (epoll_ctl(epfd(*ptr), EPOLL_CTL_DEL, ptr->fd, &ptr->event) < 0) error_flag = MEVEL_ERR_DEL;
+        ptr->ready = false;
+        retired.push_back(std::move(fdmap[ptr->fd]));
     }
+
+    ptr->fd = -1;
+
     return (error_flag == MEVEL_ERR_NONE);
 }
 
@@ -160,46 +861,97 @@ bool mevel::add_fio(callback_t cb, int fd, int evmask)
 {
     mevent              ev;
     ev.type             = MEVEL_TYPE_IO;
-    ev.cb               = cb;
+    ev.cb               = std::move(cb);
     ev.event.events     = evmask;
     ev.fd               = fd;
 
-    return add(ev);
+    return add(std::move(ev));
+}
+
+bool mevel::del_fio(int fd)
+{
+    mevent* ptr = (fd >= 0) ? find(fd) : nullptr;
+
+    if (ptr == nullptr)
+    {
+        error_flag = MEVEL_ERR_DEL;
+        return false;
+    }
+
+    return del(*ptr);
 }
 
 bool mevel::add_timer(callback_t cb, int timeout, int period)
 {
-    mevent              ev;
+    clear_error_flag();
+
+    if (!cb || timeout < 0 || period < 0)
+    {
+        error_flag = MEVEL_ERR_TIMER;
+        return false;
+    }
+
+    // timers are not backed by a file descriptor; they are keyed by a negative id
+    int id;
+
+    if (!timerids.empty())
+    {
+        id = timerids.back();
+        timerids.pop_back();
+    }
+    else
+    {
+        id = static_cast<int>(timers.size());
+        timers.emplace_back();
+    }
+
+    timers[id].reset(new mevent());
+
+    mevent&             ev = *timers[id];
     ev.type             = MEVEL_TYPE_TIMER;
-    ev.cb               = cb;
-    ev.event.events     = MEVEL_EDGE | MEVEL_READ;
-    ev.fd               = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ev.cb               = std::move(cb);
+    ev.event.events     = 0;
+    ev.fd               = -(id + 1);
 
-    if (ev.fd < 0) throw exception("adding timer failed; file descriptor is negetive", MEVEL_ERR_TIMER);
+    wheel_node_ini(&ev.tnode, &ev);
+    ev.tnode.period     = static_cast<uint64_t>(period);
 
-    struct timespec     ts;
-    struct itimerspec   itime;
+    if (timeout > 0) wheel_add(wheel, &ev.tnode, wheel_clk() + timeout);
 
-    ts.tv_sec           = timeout / 1000;
-    ts.tv_nsec          = (timeout % 1000) * 1000000;
-    itime.it_value      = ts;
+    return true;
+}
 
-    ts.tv_sec           = period / 1000;
-    ts.tv_nsec          = (period % 1000) * 1000000;
-    itime.it_interval   = ts;
+bool mevel::set_timer(const mevent& ev, int timeout, int period)
+{
+    error_flag = MEVEL_ERR_TIMER;
 
-    if (timerfd_settime(ev.fd, 0, &itime, NULL) < 0)
+    mevent* ptr = find(ev.fd);
+    if (ptr == nullptr || ptr->type != MEVEL_TYPE_TIMER || timeout < 0 || period < 0)
     {
-        ::close(ev.fd);
-        ev.fd = -1;
-        error_flag = MEVEL_ERR_TIMER;
         return false;
     }
 
-    return add(ev);
+    wheel_node_t& node  = ptr->tnode;
+    node.period         = static_cast<uint64_t>(period);
+
+    if (timeout > 0) wheel_add(wheel, &node, wheel_clk() + timeout);
+    else wheel_del(wheel, &node);
+
+    clear_error_flag();
+    return true;
+}
+
+bool mevel::clear_timer(const mevent& ev)
+{
+    return set_timer(ev, 0, 0);
 }
 
 bool mevel::add_signal(callback_t cb, int signum)
+{
+    return add_signal(std::move(cb), {signum});
+}
+
+bool mevel::add_signal(callback_t cb, std::initializer_list<int> signums)
 {
     error_flag = MEVEL_ERR_SIGNAL;
     if (!cb) return false;
@@ -223,12 +975,16 @@ bool mevel::add_signal(callback_t cb, int signum)
         else return false;
     }
 
-    if (eventmap.find(ev_signal.fd) != eventmap.end())
+    // one signalfd serves every signal; the latest callback replaces the previous one
+    if (find(ev_signal.fd) != nullptr)
     {
         if (!del(ev_signal)) return false;
     }
 
-    sigaddset(&ev_signal.smask, signum);
+    for (auto elem : signums)
+    {
+        sigaddset(&ev_signal.smask, elem);
+    }
 
     if (sigprocmask(SIG_BLOCK, &ev_signal.smask, NULL) == 0)
     {
@@ -239,82 +995,70 @@ bool mevel::add_signal(callback_t cb, int signum)
     }
     else return false;
 
-    ev_signal.cb = cb;
-
+    mevent              ev;
+    ev.type             = MEVEL_TYPE_SIGNAL;
+    ev.cb               = std::move(cb);
+    ev.event.events     = MEVEL_READ;
+    ev.smask            = ev_signal.smask;
+    ev.fd               = ev_signal.fd;
 
     clear_error_flag();
-    return add(ev_signal);
+    return add(std::move(ev));
 }
 
-bool mevel::add_signal(callback_t cb, std::initializer_list<int> signums)
+bool mevel::add_udp(callback_t cb, int stype, const char* straddr, int port, int evmask)
 {
-    error_flag = MEVEL_ERR_SIGNAL;
-    if (!cb) return false;
+    error_flag          = MEVEL_ERR_UDP;
+    mevent              ev;
+    ev.type             = MEVEL_TYPE_IO;
+    ev.cb               = std::move(cb);
+    ev.event.events     = evmask;
+    ev.fd               = udp_socket(stype, straddr, port);
 
-    for (auto elem : signums)
-    {
-        if (!add_signal(cb, elem)) return false;
-    }
+    if (ev.fd < 0) return false;
 
     clear_error_flag();
-    return true;
+    return add(std::move(ev));
 }
 
-bool mevel::add_udp(callback_t cb, int stype, const char* straddr, int port, int evmask)
+bool mevel::add_udp_dgram(callback_t cb, int stype, const char* straddr, int port, unsigned count, size_t size, bool gro)
 {
     error_flag          = MEVEL_ERR_UDP;
+
+    if (!cb) return false;
+
     mevent              ev;
-    ev.type             = MEVEL_TYPE_IO;
-    ev.cb               = cb;
-    ev.event.events     = evmask;
+    ev.type             = MEVEL_TYPE_DGRAM;
+    ev.cb               = std::move(cb);
+    ev.event.events     = MEVEL_READ;
+    ev.dgram.reset(new dgram_t());
 
-    if (stype == MEVEL_IPV4 || stype == MEVEL_IPV6)
-    {
-        struct sockaddr_in  baddr;
-        memset(&baddr, 0x00, sizeof(struct sockaddr_in));
-        baddr.sin_family    =   stype;
-        baddr.sin_port      =   htons(port);
-        if (inet_pton(stype, straddr, &baddr.sin_addr) != 1)
-        {
-            return false;
-        }
+    if (mmsg_ini(&ev.dgram->in, count ? count : MEVEL_DGRAM_BATCH, size ? size : MEVEL_DGRAM_SIZE) < 0) return false;
 
-        ev.fd               =   socket(stype, SOCK_DGRAM, 0);
+    ev.fd               = udp_socket(stype, straddr, port);
 
-        if (bind(ev.fd, (struct sockaddr*) &baddr, sizeof(struct sockaddr_in)) < 0)
-        {
-            if (ev.fd > 0) ::close(ev.fd);
-            return false;
-        }
-    }
-    else if (stype == MEVEL_UNIX)
-    {
-        struct sockaddr_un  baddr;
-        baddr.sun_family = AF_UNIX;
-        strncpy(baddr.sun_path, straddr, sizeof(baddr.sun_path) - 1);
-        ev.fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (ev.fd < 0) return false;
 
-        if (bind(ev.fd, (struct sockaddr*) &baddr, sizeof(struct sockaddr_un)) < 0)
-        {
-            if (ev.fd > 0) ::close(ev.fd);
-            return false;
-        }
-    }
-    else
+    if (gro && mmsg_gro(&ev.dgram->in, ev.fd) < 0)
     {
+        ::close(ev.fd);
         return false;
     }
 
     clear_error_flag();
-    return add(ev);
+    return add(std::move(ev));
 }
 
 bool mevel::add_tcp(callback_t cb, int stype, const char* straddr, int port, int evmask)
 {
     error_flag         = MEVEL_ERR_TCP;
+
+    // every accepted connection gets its own copy of the callback
+    if (!cb.copyable()) return false;
+
     mevent              ev;
     ev.type            = MEVEL_TYPE_ACC;
-    ev.cb              = cb;
+    ev.cb              = std::move(cb);
     ev.event.events    = MEVEL_READ;
     ev.evmask          = evmask;
 
@@ -379,13 +1123,14 @@ bool mevel::add_tcp(callback_t cb, int stype, const char* straddr, int port, int
     }
 #endif
 
-    if (listen(ev.fd, MEVEL_MAX_EVENTS) < 0)
+    if (listen(ev.fd, backlog) < 0)
     {
         ::close(ev.fd);
+        return false;
     }
 
     clear_error_flag();
-    return add(ev);
+    return add(std::move(ev));
 }
 
 }
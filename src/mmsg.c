@@ -0,0 +1,265 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include "mmsg.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO     104
+#endif
+
+// the kernel reports the GRO segment size as an int and takes the GSO one as a u16
+#define MMSG_CTL    CMSG_SPACE(sizeof(int))
+
+static void mmsg_ctl_seg(struct msghdr* hdr, void* ctl, unsigned short seg)
+{
+    hdr->msg_control    = ctl;
+    hdr->msg_controllen = CMSG_SPACE(sizeof(unsigned short));
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+
+    cmsg->cmsg_level    = SOL_UDP;
+    cmsg->cmsg_type     = UDP_SEGMENT;
+    cmsg->cmsg_len      = CMSG_LEN(sizeof(unsigned short));
+    memcpy(CMSG_DATA(cmsg), &seg, sizeof(unsigned short));
+}
+
+int mmsg_ini(mmsg_t* mmsg, unsigned count, size_t size)
+{
+    memset(mmsg, 0x00, sizeof(mmsg_t));
+
+    if (count == 0 || size == 0) return -1;
+
+    mmsg->msgs  = (struct mmsghdr*) calloc(count, sizeof(struct mmsghdr));
+    mmsg->iovs  = (struct iovec*) calloc(count, sizeof(struct iovec));
+    mmsg->addrs = (struct sockaddr_storage*) calloc(count, sizeof(struct sockaddr_storage));
+    mmsg->bufs  = (char*) malloc((size_t) count * size);
+    mmsg->ctls  = (char*) calloc(count, MMSG_CTL);
+    mmsg->segs  = (unsigned short*) calloc(count, sizeof(unsigned short));
+
+    if (mmsg->msgs == NULL || mmsg->iovs == NULL || mmsg->addrs == NULL || mmsg->bufs == NULL ||
+        mmsg->ctls == NULL || mmsg->segs == NULL)
+    {
+        mmsg_rel(mmsg);
+        return -1;
+    }
+
+    mmsg->count = count;
+    mmsg->size  = size;
+
+    // the slots never move; only the lengths change between calls
+    for (unsigned i = 0; i < count; i++)
+    {
+        mmsg->iovs[i].iov_base          = mmsg->bufs + (size_t) i * size;
+        mmsg->iovs[i].iov_len           = size;
+        mmsg->msgs[i].msg_hdr.msg_iov   = &mmsg->iovs[i];
+        mmsg->msgs[i].msg_hdr.msg_iovlen = 1;
+        mmsg->msgs[i].msg_hdr.msg_name  = &mmsg->addrs[i];
+    }
+
+    return 0;
+}
+
+void mmsg_rel(mmsg_t* mmsg)
+{
+    free(mmsg->msgs);
+    free(mmsg->iovs);
+    free(mmsg->addrs);
+    free(mmsg->bufs);
+    free(mmsg->ctls);
+    free(mmsg->segs);
+    memset(mmsg, 0x00, sizeof(mmsg_t));
+}
+
+int mmsg_rcv(mmsg_t* mmsg, int fd)
+{
+    for (unsigned i = 0; i < mmsg->count; i++)
+    {
+        mmsg->iovs[i].iov_len               = mmsg->size;
+        mmsg->msgs[i].msg_hdr.msg_namelen   = sizeof(struct sockaddr_storage);
+        mmsg->msgs[i].msg_hdr.msg_control   = mmsg->ctls + i * MMSG_CTL;
+        mmsg->msgs[i].msg_hdr.msg_controllen = MMSG_CTL;
+        mmsg->msgs[i].msg_hdr.msg_flags     = 0;
+    }
+
+    int ret = recvmmsg(fd, mmsg->msgs, mmsg->count, MSG_DONTWAIT, NULL);
+
+    mmsg->len = (ret > 0) ? (unsigned) ret : 0;
+
+    for (unsigned i = 0; i < mmsg->len; i++)
+    {
+        struct msghdr*  hdr     = &mmsg->msgs[i].msg_hdr;
+        struct cmsghdr* cmsg    = NULL;
+        int             seg     = 0;
+
+        for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) memcpy(&seg, CMSG_DATA(cmsg), sizeof(int));
+        }
+
+        mmsg->segs[i] = (unsigned short) seg;
+    }
+
+    return ret;
+}
+
+int mmsg_put(mmsg_t* mmsg, const void* buf, size_t len, const struct sockaddr* addr, socklen_t alen, unsigned short seg)
+{
+    if (mmsg->len == mmsg->count || len > mmsg->size || alen > sizeof(struct sockaddr_storage)) return -1;
+
+    unsigned indx = mmsg->len++;
+
+    memcpy(mmsg->iovs[indx].iov_base, buf, len);
+    mmsg->iovs[indx].iov_len = len;
+
+    // connected sockets send without an address
+    if (addr && alen) memcpy(&mmsg->addrs[indx], addr, alen);
+    else alen = 0;
+
+    mmsg->msgs[indx].msg_hdr.msg_namelen = alen;
+    mmsg->segs[indx] = seg;
+
+    if (seg) mmsg_ctl_seg(&mmsg->msgs[indx].msg_hdr, mmsg->ctls + indx * MMSG_CTL, seg);
+    else
+    {
+        mmsg->msgs[indx].msg_hdr.msg_control    = NULL;
+        mmsg->msgs[indx].msg_hdr.msg_controllen = 0;
+    }
+
+    return 0;
+}
+
+int mmsg_out(mmsg_t* mmsg, int fd, const void* buf, size_t len, const struct sockaddr* addr, socklen_t alen, unsigned short seg)
+{
+    if (len > mmsg->size)
+    {
+        if (mmsg->len) mmsg_snd(mmsg, fd);
+        return mmsg_snd_one(fd, buf, len, addr, alen, seg);
+    }
+
+    if (mmsg->len == mmsg->count) mmsg_snd(mmsg, fd);
+
+    return mmsg_put(mmsg, buf, len, addr, alen, seg);
+}
+
+int mmsg_snd_one(int fd, const void* buf, size_t len, const struct sockaddr* addr, socklen_t alen, unsigned short seg)
+{
+    struct msghdr   hdr;
+    struct iovec    iov;
+    char            ctl[MMSG_CTL];
+    ssize_t         ret;
+
+    memset(&hdr, 0x00, sizeof(struct msghdr));
+    memset(ctl, 0x00, sizeof(ctl));
+
+    iov.iov_base    = (void*) buf;
+    iov.iov_len     = len;
+    hdr.msg_iov     = &iov;
+    hdr.msg_iovlen  = 1;
+    hdr.msg_name    = (void*) addr;
+    hdr.msg_namelen = addr ? alen : 0;
+
+    if (seg) mmsg_ctl_seg(&hdr, ctl, seg);
+
+    do ret = sendmsg(fd, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+    while (ret < 0 && errno == EINTR);
+
+    return (ret < 0) ? -1 : 0;
+}
+
+int mmsg_snd(mmsg_t* mmsg, int fd)
+{
+    unsigned indx = 0;
+    int      sent = 0;
+    int      fail = 0;
+
+    while (indx < mmsg->len)
+    {
+        int ret = sendmmsg(fd, mmsg->msgs + indx, mmsg->len - indx, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (ret > 0)
+        {
+            indx += (unsigned) ret;
+            sent += ret;
+            continue;
+        }
+
+        if (errno == EINTR) continue;
+
+        fail = 1;
+
+        // a full socket buffer drops the rest; any other error only the refused datagram
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        indx++;
+    }
+
+    mmsg->len = 0;
+
+    return fail ? -1 : sent;
+}
+
+void* mmsg_buf(const mmsg_t* mmsg, unsigned indx, size_t* len)
+{
+    if (indx >= mmsg->len) return NULL;
+
+    if (len) *len = mmsg->msgs[indx].msg_len;
+
+    return mmsg->iovs[indx].iov_base;
+}
+
+const struct sockaddr* mmsg_addr(const mmsg_t* mmsg, unsigned indx, socklen_t* alen)
+{
+    if (indx >= mmsg->len) return NULL;
+
+    if (alen) *alen = mmsg->msgs[indx].msg_hdr.msg_namelen;
+
+    return (const struct sockaddr*) &mmsg->addrs[indx];
+}
+
+unsigned short mmsg_seg(const mmsg_t* mmsg, unsigned indx)
+{
+    return (indx < mmsg->len) ? mmsg->segs[indx] : 0;
+}
+
+int mmsg_gro(mmsg_t* mmsg, int fd)
+{
+    int one = 1;
+
+    if (mmsg->len) return -1;
+
+    if (mmsg->size < MMSG_MAX)
+    {
+        mmsg_t grown;
+
+        if (mmsg_ini(&grown, mmsg->count, MMSG_MAX) < 0) return -1;
+
+        mmsg_rel(mmsg);
+        *mmsg = grown;
+    }
+
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(int));
+}
@@ -0,0 +1,50 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mpsc.h"
+
+void mpsc_ini(mpsc_t* mpsc)
+{
+    __atomic_store_n(&mpsc->head, NULL, __ATOMIC_RELEASE);
+}
+
+int mpsc_put(mpsc_t* mpsc, mpsc_node_t* node)
+{
+    mpsc_node_t* head = __atomic_load_n(&mpsc->head, __ATOMIC_RELAXED);
+
+    do node->nxt = head;
+    while (!__atomic_compare_exchange_n(&mpsc->head, &head, node, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    return head == NULL;
+}
+
+mpsc_node_t* mpsc_get(mpsc_t* mpsc)
+{
+    // the list is taken whole, so nodes are never popped under a producer
+    mpsc_node_t* node = __atomic_exchange_n(&mpsc->head, NULL, __ATOMIC_ACQUIRE);
+    mpsc_node_t* list = NULL;
+
+    // pushes are LIFO; reverse them into posting order
+    while (node)
+    {
+        mpsc_node_t* nxt = node->nxt;
+        node->nxt = list;
+        list = node;
+        node = nxt;
+    }
+
+    return list;
+}
@@ -0,0 +1,177 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+int ring_ini(ring_t* ring, size_t cap)
+{
+    size_t size = 1;
+
+    while (size < cap) size <<= 1;
+
+    ring->buf   = (char*) malloc(size);
+    ring->cap   = ring->buf ? size : 0;
+    ring->head  = 0;
+    ring->tail  = 0;
+
+    return ring->buf ? 0 : -1;
+}
+
+void ring_rel(ring_t* ring)
+{
+    free(ring->buf);
+    ring->buf   = NULL;
+    ring->cap   = 0;
+    ring->head  = 0;
+    ring->tail  = 0;
+}
+
+size_t ring_len(const ring_t* ring)
+{
+    return ring->tail - ring->head;
+}
+
+size_t ring_spc(const ring_t* ring)
+{
+    return ring->cap - (ring->tail - ring->head);
+}
+
+int ring_res(ring_t* ring, size_t len, size_t max)
+{
+    size_t used = ring_len(ring);
+    size_t size = ring->cap ? ring->cap : 1;
+
+    if (ring->cap - used >= len) return 0;
+
+    while (size - used < len) size <<= 1;
+
+    if (max && size > max) return -1;
+
+    char* buf = (char*) malloc(size);
+
+    if (buf == NULL) return -1;
+
+    // the contents start at offset zero of the new buffer
+    ring_get(ring, buf, used);
+    free(ring->buf);
+
+    ring->buf   = buf;
+    ring->cap   = size;
+    ring->head  = 0;
+    ring->tail  = used;
+
+    return 0;
+}
+
+size_t ring_put(ring_t* ring, const void* data, size_t len)
+{
+    struct iovec    iov[2];
+    size_t          done = 0;
+    int             cnt  = ring_iov_wr(ring, iov);
+
+    for (int i = 0; i < cnt && done < len; i++)
+    {
+        size_t part = (len - done < iov[i].iov_len) ? len - done : iov[i].iov_len;
+        memcpy(iov[i].iov_base, (const char*) data + done, part);
+        done += part;
+    }
+
+    ring->tail += done;
+
+    return done;
+}
+
+size_t ring_get(ring_t* ring, void* data, size_t len)
+{
+    struct iovec    iov[2];
+    size_t          done = 0;
+    int             cnt  = ring_iov_rd(ring, iov);
+
+    for (int i = 0; i < cnt && done < len; i++)
+    {
+        size_t part = (len - done < iov[i].iov_len) ? len - done : iov[i].iov_len;
+        memcpy((char*) data + done, iov[i].iov_base, part);
+        done += part;
+    }
+
+    ring_adv_rd(ring, done);
+
+    return done;
+}
+
+int ring_iov_rd(const ring_t* ring, struct iovec iov[2])
+{
+    size_t len = ring_len(ring);
+
+    if (len == 0) return 0;
+
+    size_t off  = ring->head & (ring->cap - 1);
+    size_t part = ring->cap - off;
+
+    iov[0].iov_base = ring->buf + off;
+
+    if (len <= part)
+    {
+        iov[0].iov_len = len;
+        return 1;
+    }
+
+    iov[0].iov_len  = part;
+    iov[1].iov_base = ring->buf;
+    iov[1].iov_len  = len - part;
+
+    return 2;
+}
+
+int ring_iov_wr(const ring_t* ring, struct iovec iov[2])
+{
+    size_t spc = ring_spc(ring);
+
+    if (spc == 0) return 0;
+
+    size_t off  = ring->tail & (ring->cap - 1);
+    size_t part = ring->cap - off;
+
+    iov[0].iov_base = ring->buf + off;
+
+    if (spc <= part)
+    {
+        iov[0].iov_len = spc;
+        return 1;
+    }
+
+    iov[0].iov_len  = part;
+    iov[1].iov_base = ring->buf;
+    iov[1].iov_len  = spc - part;
+
+    return 2;
+}
+
+void ring_adv_rd(ring_t* ring, size_t len)
+{
+    ring->head += len;
+
+    // an empty ring starts over so the next write is contiguous
+    if (ring->head == ring->tail) ring->head = ring->tail = 0;
+}
+
+void ring_adv_wr(ring_t* ring, size_t len)
+{
+    ring->tail += len;
+}
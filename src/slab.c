@@ -0,0 +1,144 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "slab.h"
+
+static int slab_grw(slab_ctx_t* ctx, size_t count)
+{
+    slab_hdr_t* chunk = (slab_hdr_t*) malloc(sizeof(slab_hdr_t) + count * ctx->size);
+
+    if (chunk == NULL) return -1;
+
+    chunk->h.nxt    = ctx->chunks;
+    chunk->h.tag    = 0;
+    ctx->chunks     = chunk;
+
+    char* ptr = (char*)(chunk + 1);
+
+    // link back to front so the free list hands out ascending addresses
+    for (size_t i = count; i-- > 0;)
+    {
+        slab_hdr_t* hdr = (slab_hdr_t*)(ptr + i * ctx->size);
+        hdr->h.nxt  = ctx->free;
+        hdr->h.tag  = 0;
+        ctx->free   = hdr;
+    }
+
+    ctx->count += count;
+
+    return 0;
+}
+
+slab_ctx_t* slab_ini(size_t size, size_t count, size_t chunk)
+{
+    slab_ctx_t* ctx = (slab_ctx_t*) malloc(sizeof(slab_ctx_t));
+
+    if (ctx == NULL) return NULL;
+
+    // keep every object aligned like its header
+    size = (size + sizeof(slab_hdr_t) - 1) / sizeof(slab_hdr_t) * sizeof(slab_hdr_t);
+
+    ctx->size   = sizeof(slab_hdr_t) + size;
+    ctx->chunk  = chunk;
+    ctx->free   = NULL;
+    ctx->chunks = NULL;
+    ctx->count  = 0;
+    ctx->used   = 0;
+
+    if (count && slab_grw(ctx, count) < 0)
+    {
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+void slab_rel(slab_ctx_t* ctx)
+{
+    if (ctx == NULL) return;
+
+    // objects still carved from a chunk go with it; heap objects are put by their owner
+    while (ctx->chunks)
+    {
+        slab_hdr_t* chunk = ctx->chunks;
+        ctx->chunks = chunk->h.nxt;
+        free(chunk);
+    }
+
+    free(ctx);
+}
+
+void* slab_get(slab_ctx_t* ctx)
+{
+    if (ctx == NULL) return NULL;
+
+    if (ctx->free == NULL && ctx->chunk) slab_grw(ctx, ctx->chunk);
+
+    slab_hdr_t* hdr = ctx->free;
+
+    if (hdr == NULL) return slab_heap(ctx->size - sizeof(slab_hdr_t));
+
+    ctx->free   = hdr->h.nxt;
+    hdr->h.slab = ctx;
+    hdr->h.tag  = SLAB_TAG;
+    ctx->used++;
+
+    return hdr + 1;
+}
+
+void* slab_heap(size_t size)
+{
+    slab_hdr_t* hdr = (slab_hdr_t*) malloc(sizeof(slab_hdr_t) + size);
+
+    if (hdr == NULL) return NULL;
+
+    hdr->h.slab = NULL;
+    hdr->h.tag  = SLAB_TAG;
+
+    return hdr + 1;
+}
+
+int slab_put(void* ptr)
+{
+    if (!slab_own(ptr)) return -1;
+
+    slab_hdr_t* hdr     = (slab_hdr_t*) ptr - 1;
+    slab_ctx_t* ctx     = hdr->h.slab;
+
+    // a second put of the same object is refused too
+    hdr->h.tag = 0;
+
+    if (ctx == NULL)
+    {
+        free(hdr);
+        return 0;
+    }
+
+    hdr->h.nxt  = ctx->free;
+    ctx->free   = hdr;
+    ctx->used--;
+
+    return 0;
+}
+
+int slab_own(const void* ptr)
+{
+    return ptr != NULL && ((const slab_hdr_t*) ptr - 1)->h.tag == SLAB_TAG;
+}
@@ -0,0 +1,145 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+int trace_ini(trace_t* trace, size_t cap)
+{
+    size_t size = 1;
+
+    while (size < cap) size <<= 1;
+
+    trace->recs = (trace_rec_t*) calloc(size, sizeof(trace_rec_t));
+    trace->cap  = trace->recs ? size : 0;
+    trace->head = 0;
+
+    return trace->recs ? 0 : -1;
+}
+
+void trace_rel(trace_t* trace)
+{
+    free(trace->recs);
+    trace->recs = NULL;
+    trace->cap  = 0;
+}
+
+// a sequence lock per slot: the position is cleared first and set again last;
+// release stores keep the fields behind the cleared position
+static void trace_put(trace_t* trace, uint64_t pos, const trace_rec_t* rec)
+{
+    trace_rec_t* slot = &trace->recs[pos & (trace->cap - 1)];
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->start, rec->start, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->end, rec->end, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->fd, rec->fd, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->flags, rec->flags, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->tid, rec->tid, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->type, rec->type, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->err, rec->err, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+void trace_add(trace_t* trace, const trace_rec_t* rec)
+{
+    uint64_t pos = __atomic_load_n(&trace->head, __ATOMIC_RELAXED);
+
+    trace_put(trace, pos, rec);
+    __atomic_store_n(&trace->head, pos + 1, __ATOMIC_RELEASE);
+}
+
+void trace_add_mt(trace_t* trace, const trace_rec_t* rec)
+{
+    trace_put(trace, __atomic_fetch_add(&trace->head, 1, __ATOMIC_ACQ_REL), rec);
+}
+
+// acquire loads keep the second look at the position behind the fields
+static int trace_read(const trace_t* trace, uint64_t pos, trace_rec_t* out)
+{
+    const trace_rec_t* slot = &trace->recs[pos & (trace->cap - 1)];
+
+    out->seq    = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    out->start  = __atomic_load_n(&slot->start, __ATOMIC_ACQUIRE);
+    out->end    = __atomic_load_n(&slot->end, __ATOMIC_ACQUIRE);
+    out->fd     = __atomic_load_n(&slot->fd, __ATOMIC_ACQUIRE);
+    out->flags  = __atomic_load_n(&slot->flags, __ATOMIC_ACQUIRE);
+    out->tid    = __atomic_load_n(&slot->tid, __ATOMIC_ACQUIRE);
+    out->type   = __atomic_load_n(&slot->type, __ATOMIC_ACQUIRE);
+    out->err    = __atomic_load_n(&slot->err, __ATOMIC_ACQUIRE);
+
+    return out->seq == pos + 1 && __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == pos + 1;
+}
+
+size_t trace_get(const trace_t* trace, trace_rec_t* out, size_t max)
+{
+    uint64_t    head    = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+    uint64_t    count   = (head < trace->cap) ? head : trace->cap;
+    size_t      len     = 0;
+
+    if (count > max) count = max;
+
+    for (uint64_t pos = head - count; pos < head; pos++)
+    {
+        if (trace_read(trace, pos, &out[len])) len++;
+    }
+
+    return len;
+}
+
+static int trace_write(int fd, const void* buf, size_t len)
+{
+    const char* ptr = (const char*) buf;
+
+    while (len)
+    {
+        ssize_t ret = write(fd, ptr, len);
+
+        if (ret <= 0) return -1;
+
+        ptr += ret;
+        len -= (size_t) ret;
+    }
+
+    return 0;
+}
+
+int trace_dump(const trace_t* trace, int fd)
+{
+    trace_rec_t*    recs    = (trace_rec_t*) malloc(trace->cap * sizeof(trace_rec_t));
+    trace_hdr_t     hdr;
+
+    if (recs == NULL) return -1;
+
+    memset(&hdr, 0x00, sizeof(trace_hdr_t));
+    hdr.magic   = TRACE_MAGIC;
+    hdr.size    = sizeof(trace_rec_t);
+    hdr.pid     = (uint32_t) getpid();
+    hdr.count   = trace_get(trace, recs, trace->cap);
+
+    int ret = trace_write(fd, &hdr, sizeof(trace_hdr_t));
+
+    if (ret == 0) ret = trace_write(fd, recs, hdr.count * sizeof(trace_rec_t));
+
+    free(recs);
+
+    return ret;
+}
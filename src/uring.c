@@ -0,0 +1,255 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "uring.h"
+
+struct uring_ctx {
+    int                         fd;
+    unsigned*                   sq_head;
+    unsigned*                   sq_tail;
+    unsigned                    sq_mask;
+    unsigned                    sq_entries;
+    unsigned                    sq_local;   // tail including entries not yet published
+    struct io_uring_sqe*        sqes;
+    unsigned*                   cq_head;
+    unsigned*                   cq_tail;
+    unsigned                    cq_mask;
+    struct io_uring_cqe*        cqes;
+    void*                       rptr;       // shared sq and cq rings
+    size_t                      rlen;
+    size_t                      slen;
+    struct io_uring_buf_ring*   br;         // provided buffer ring
+    size_t                      brlen;
+    char*                       bufs;
+    unsigned                    bcount;
+    unsigned                    bsize;
+    unsigned short              btail;
+};
+
+uring_ctx_t* uring_ini(unsigned entries)
+{
+    struct io_uring_params  params;
+    uring_ctx_t*            ctx = (uring_ctx_t*) calloc(1, sizeof(uring_ctx_t));
+
+    if (ctx == NULL) return NULL;
+
+    memset(&params, 0x00, sizeof(struct io_uring_params));
+    params.flags        = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE;
+    params.cq_entries   = entries * 4;
+
+    ctx->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+
+    if (ctx->fd < 0)
+    {
+        free(ctx);
+        return NULL;
+    }
+
+    // the backend waits with a timeout argument and maps both rings at once
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+    {
+        close(ctx->fd);
+        free(ctx);
+        return NULL;
+    }
+
+    size_t sqlen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqlen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    ctx->rlen = (sqlen > cqlen) ? sqlen : cqlen;
+    ctx->slen = params.sq_entries * sizeof(struct io_uring_sqe);
+    ctx->rptr = mmap(NULL, ctx->rlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ctx->fd, IORING_OFF_SQ_RING);
+    ctx->sqes = (struct io_uring_sqe*) mmap(NULL, ctx->slen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ctx->fd, IORING_OFF_SQES);
+
+    if (ctx->rptr == MAP_FAILED || ctx->sqes == MAP_FAILED)
+    {
+        if (ctx->rptr != MAP_FAILED) munmap(ctx->rptr, ctx->rlen);
+        if (ctx->sqes != MAP_FAILED) munmap(ctx->sqes, ctx->slen);
+        close(ctx->fd);
+        free(ctx);
+        return NULL;
+    }
+
+    char* ptr = (char*) ctx->rptr;
+
+    ctx->sq_head    = (unsigned*) (ptr + params.sq_off.head);
+    ctx->sq_tail    = (unsigned*) (ptr + params.sq_off.tail);
+    ctx->sq_mask    = *(unsigned*) (ptr + params.sq_off.ring_mask);
+    ctx->sq_entries = params.sq_entries;
+    ctx->sq_local   = *ctx->sq_tail;
+    ctx->cq_head    = (unsigned*) (ptr + params.cq_off.head);
+    ctx->cq_tail    = (unsigned*) (ptr + params.cq_off.tail);
+    ctx->cq_mask    = *(unsigned*) (ptr + params.cq_off.ring_mask);
+    ctx->cqes       = (struct io_uring_cqe*) (ptr + params.cq_off.cqes);
+
+    // submission slots map one to one onto the sqe array
+    unsigned* array = (unsigned*) (ptr + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) array[i] = i;
+
+    return ctx;
+}
+
+void uring_rel(uring_ctx_t* ctx)
+{
+    if (ctx == NULL) return;
+
+    munmap(ctx->sqes, ctx->slen);
+    munmap(ctx->rptr, ctx->rlen);
+    close(ctx->fd);
+
+    if (ctx->br) munmap(ctx->br, ctx->brlen);
+    free(ctx->bufs);
+    free(ctx);
+}
+
+struct io_uring_sqe* uring_sqe(uring_ctx_t* ctx)
+{
+    unsigned head = __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+
+    if (ctx->sq_local - head >= ctx->sq_entries) return NULL;
+
+    struct io_uring_sqe* sqe = &ctx->sqes[ctx->sq_local & ctx->sq_mask];
+    memset(sqe, 0x00, sizeof(struct io_uring_sqe));
+    ctx->sq_local++;
+
+    return sqe;
+}
+
+int uring_sub(uring_ctx_t* ctx, unsigned wait, int timeout)
+{
+    struct io_uring_getevents_arg   arg;
+    struct __kernel_timespec        ts;
+    unsigned                        flags   = 0;
+
+    __atomic_store_n(ctx->sq_tail, ctx->sq_local, __ATOMIC_RELEASE);
+
+    unsigned submit = ctx->sq_local - __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+
+    if (submit == 0 && wait == 0) return 0;
+
+    memset(&arg, 0x00, sizeof(struct io_uring_getevents_arg));
+
+    if (wait)
+    {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+        if (timeout >= 0)
+        {
+            ts.tv_sec   = timeout / 1000;
+            ts.tv_nsec  = (timeout % 1000) * 1000000LL;
+            arg.ts      = (unsigned long long) &ts;
+        }
+    }
+
+    int ret = (int) syscall(__NR_io_uring_enter, ctx->fd, submit, wait, flags,
+                            wait ? &arg : NULL, wait ? sizeof(arg) : 0);
+
+    // running out of time is not an error for the caller
+    if (ret < 0 && errno == ETIME) ret = 0;
+
+    return ret;
+}
+
+struct io_uring_cqe* uring_cqe(uring_ctx_t* ctx)
+{
+    unsigned head = *ctx->cq_head;
+
+    if (head == __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+
+    return &ctx->cqes[head & ctx->cq_mask];
+}
+
+void uring_cqe_del(uring_ctx_t* ctx)
+{
+    __atomic_store_n(ctx->cq_head, *ctx->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_buf_ini(uring_ctx_t* ctx, unsigned count, unsigned size, unsigned short bgid)
+{
+    // the kernel wants a power of two number of entries
+    if (ctx == NULL || ctx->br || count == 0 || count > 32768 || (count & (count - 1))) return -1;
+
+    long page   = sysconf(_SC_PAGESIZE);
+    ctx->brlen  = (count * sizeof(struct io_uring_buf) + page - 1) & ~(size_t)(page - 1);
+    ctx->br     = (struct io_uring_buf_ring*) mmap(NULL, ctx->brlen, PROT_READ | PROT_WRITE,
+                                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (ctx->br == MAP_FAILED)
+    {
+        ctx->br = NULL;
+        return -1;
+    }
+
+    ctx->bufs = (char*) malloc((size_t) count * size);
+
+    if (ctx->bufs == NULL)
+    {
+        munmap(ctx->br, ctx->brlen);
+        ctx->br = NULL;
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0x00, sizeof(struct io_uring_buf_reg));
+    reg.ring_addr       = (unsigned long long) ctx->br;
+    reg.ring_entries    = count;
+    reg.bgid            = bgid;
+
+    if (syscall(__NR_io_uring_register, ctx->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        munmap(ctx->br, ctx->brlen);
+        free(ctx->bufs);
+        ctx->br     = NULL;
+        ctx->bufs   = NULL;
+        return -1;
+    }
+
+    ctx->bcount = count;
+    ctx->bsize  = size;
+    ctx->btail  = 0;
+
+    for (unsigned i = 0; i < count; i++) uring_buf_put(ctx, (unsigned short) i);
+
+    return 0;
+}
+
+void* uring_buf(uring_ctx_t* ctx, unsigned short bid)
+{
+    return ctx->bufs + (size_t) bid * ctx->bsize;
+}
+
+void uring_buf_put(uring_ctx_t* ctx, unsigned short bid)
+{
+    struct io_uring_buf* buf = &ctx->br->bufs[ctx->btail & (ctx->bcount - 1)];
+
+    buf->addr   = (unsigned long long) uring_buf(ctx, bid);
+    buf->len    = ctx->bsize;
+    buf->bid    = bid;
+
+    ctx->btail++;
+    __atomic_store_n(&ctx->br->tail, ctx->btail, __ATOMIC_RELEASE);
+}
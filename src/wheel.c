@@ -0,0 +1,249 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
+#include <time.h>
+
+#include "wheel.h"
+
+// the slot bitmaps are single 64-bit words
+#if WHEEL_SLOTS != 64
+#error "WHEEL_SLOTS must be 64"
+#endif
+
+static void wheel_lnk(wheel_node_t* head, wheel_node_t* node)
+{
+    node->nxt       = head;
+    node->prv       = head->prv;
+    head->prv->nxt  = node;
+    head->prv       = node;
+}
+
+static void wheel_unl(wheel_node_t* node)
+{
+    node->prv->nxt  = node->nxt;
+    node->nxt->prv  = node->prv;
+    node->nxt       = NULL;
+    node->prv       = NULL;
+}
+
+static void wheel_put(wheel_ctx_t* ctx, wheel_node_t* node)
+{
+    if (node->expire <= ctx->clk)
+    {
+        wheel_lnk(&ctx->due, node);
+        return;
+    }
+
+    uint64_t    delta   = node->expire - ctx->clk;
+    uint64_t    expire  = node->expire;
+    int         level   = 0;
+
+    while (level < WHEEL_LEVELS && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+    {
+        level++;
+    }
+
+    if (level == WHEEL_LEVELS)
+    {
+        // out of range; park it at the farthest slot and place it again on cascade
+        level   = WHEEL_LEVELS - 1;
+        expire  = ctx->clk + ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    }
+
+    int slot = (int)((expire >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+    wheel_lnk(&ctx->slots[level][slot], node);
+    ctx->bitmap[level] |= (uint64_t)1 << slot;
+}
+
+static void wheel_cas(wheel_ctx_t* ctx, int level, int slot)
+{
+    wheel_node_t*   head = &ctx->slots[level][slot];
+    wheel_node_t*   node = NULL;
+
+    ctx->bitmap[level] &= ~((uint64_t)1 << slot);
+
+    while (head->nxt != head)
+    {
+        node = head->nxt;
+        wheel_unl(node);
+        wheel_put(ctx, node);
+    }
+}
+
+// next tick after clk at which a slot has to be expired or cascaded
+static uint64_t wheel_tck(wheel_ctx_t* ctx)
+{
+    uint64_t tick = UINT64_MAX;
+
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        uint64_t bitmap = ctx->bitmap[level];
+        if (bitmap == 0) continue;
+
+        int         shift   = WHEEL_BITS * level;
+        uint64_t    base    = ctx->clk >> shift;
+        int         rot     = (int)((base + 1) & WHEEL_MASK);
+
+        if (rot) bitmap = (bitmap >> rot) | (bitmap << (WHEEL_SLOTS - rot));
+
+        uint64_t next = (base + 1 + __builtin_ctzll(bitmap)) << shift;
+        if (next < tick) tick = next;
+    }
+
+    return tick;
+}
+
+static void wheel_adv(wheel_ctx_t* ctx, uint64_t now)
+{
+    while (ctx->clk < now)
+    {
+        uint64_t tick = wheel_tck(ctx);
+
+        if (tick > now)
+        {
+            ctx->clk = now;
+            break;
+        }
+
+        ctx->clk = tick;
+
+        // cascade from the outermost level that wrapped on this tick
+        int level = 1;
+        while (level < WHEEL_LEVELS && (tick & (((uint64_t)1 << (WHEEL_BITS * level)) - 1)) == 0)
+        {
+            level++;
+        }
+
+        while (--level > 0)
+        {
+            wheel_cas(ctx, level, (int)((tick >> (WHEEL_BITS * level)) & WHEEL_MASK));
+        }
+
+        wheel_cas(ctx, 0, (int)(tick & WHEEL_MASK));
+    }
+}
+
+uint64_t wheel_clk()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+wheel_ctx_t* wheel_ini(uint64_t now)
+{
+    wheel_ctx_t* ctx = (wheel_ctx_t*) malloc(sizeof(wheel_ctx_t));
+
+    if (ctx)
+    {
+        ctx->clk    = now;
+        ctx->size   = 0;
+        ctx->due.nxt = &ctx->due;
+        ctx->due.prv = &ctx->due;
+
+        for (int level = 0; level < WHEEL_LEVELS; level++)
+        {
+            ctx->bitmap[level] = 0;
+            for (int slot = 0; slot < WHEEL_SLOTS; slot++)
+            {
+                ctx->slots[level][slot].nxt = &ctx->slots[level][slot];
+                ctx->slots[level][slot].prv = &ctx->slots[level][slot];
+            }
+        }
+    }
+
+    return ctx;
+}
+
+void wheel_rel(wheel_ctx_t* ctx)
+{
+    // the nodes are owned by the caller
+    free(ctx);
+}
+
+void wheel_node_ini(wheel_node_t* node, void* ptr)
+{
+    node->ptr       = ptr;
+    node->nxt       = NULL;
+    node->prv       = NULL;
+    node->expire    = 0;
+    node->period    = 0;
+}
+
+int wheel_node_linked(const wheel_node_t* node)
+{
+    return node->nxt != NULL;
+}
+
+void wheel_add(wheel_ctx_t* ctx, wheel_node_t* node, uint64_t expire)
+{
+    if (ctx == NULL || node == NULL) return;
+
+    wheel_del(ctx, node);
+
+    node->expire = expire;
+    wheel_put(ctx, node);
+    ctx->size++;
+}
+
+void wheel_del(wheel_ctx_t* ctx, wheel_node_t* node)
+{
+    if (ctx == NULL || node == NULL || node->nxt == NULL) return;
+
+    wheel_node_t* head = node->nxt;
+    wheel_unl(node);
+    ctx->size--;
+
+    // the slot became empty; the sentinel address tells which bit to clear
+    if (head->nxt == head && head >= &ctx->slots[0][0] && head <= &ctx->slots[WHEEL_LEVELS - 1][WHEEL_MASK])
+    {
+        ptrdiff_t indx = head - &ctx->slots[0][0];
+        ctx->bitmap[indx / WHEEL_SLOTS] &= ~((uint64_t)1 << (indx % WHEEL_SLOTS));
+    }
+}
+
+wheel_node_t* wheel_pop(wheel_ctx_t* ctx, uint64_t now)
+{
+    if (ctx == NULL) return NULL;
+
+    wheel_adv(ctx, now);
+
+    if (ctx->due.nxt == &ctx->due) return NULL;
+
+    wheel_node_t* node = ctx->due.nxt;
+    wheel_unl(node);
+    ctx->size--;
+
+    return node;
+}
+
+int wheel_nxt(wheel_ctx_t* ctx, uint64_t now)
+{
+    if (ctx == NULL || ctx->size == 0) return -1;
+    if (ctx->due.nxt != &ctx->due) return 0;
+
+    uint64_t tick = wheel_tck(ctx);
+
+    if (tick <= now) return 0;
+    if (tick - now > INT_MAX) return INT_MAX;
+
+    return (int)(tick - now);
+}
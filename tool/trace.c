@@ -0,0 +1,144 @@
+/*
+ *   Copyright 2018 Behrooz Kamary
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+// converts a trace ring written by mevel_dump_trace to Chrome trace JSON, which
+// chrome://tracing and Perfetto open; every callback and wait becomes a complete event
+//
+//  mevel_trace [-m min_us] dump [out.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <types.h>
+#include <trace.h>
+
+static const char* trace_name(unsigned type)
+{
+    switch (type)
+    {
+        case TRACE_WAIT:        return "wait";
+        case MEVEL_TYPE_IO:     return "io";
+        case MEVEL_TYPE_SIGNAL: return "signal";
+        case MEVEL_TYPE_TIMER:  return "timer";
+        case MEVEL_TYPE_ACC:    return "accept";
+        case MEVEL_TYPE_RCV:    return "recv";
+        case MEVEL_TYPE_CONN:   return "conn";
+        case MEVEL_TYPE_DGRAM:  return "dgram";
+        default:                return "unknown";
+    }
+}
+
+static int trace_load(FILE* in, trace_hdr_t* hdr, trace_rec_t** recs)
+{
+    if (fread(hdr, sizeof(trace_hdr_t), 1, in) != 1 || hdr->magic != TRACE_MAGIC || hdr->size < sizeof(trace_rec_t))
+    {
+        return -1;
+    }
+
+    *recs = (trace_rec_t*) calloc(hdr->count ? hdr->count : 1, sizeof(trace_rec_t));
+
+    if (*recs == NULL) return -1;
+
+    // records of a newer writer may have grown; the known part comes first
+    for (uint64_t indx = 0; indx < hdr->count; indx++)
+    {
+        if (fread(&(*recs)[indx], sizeof(trace_rec_t), 1, in) != 1) return -1;
+        if (hdr->size > sizeof(trace_rec_t) && fseek(in, hdr->size - sizeof(trace_rec_t), SEEK_CUR) < 0) return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    trace_hdr_t     hdr;
+    trace_rec_t*    recs    = NULL;
+    double          min     = 0.0;
+    int             opt;
+
+    while ((opt = getopt(argc, argv, "m:")) != -1)
+    {
+        if (opt == 'm') min = atof(optarg);
+        else break;
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-m min_us] dump [out.json]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* in    = fopen(argv[optind], "rb");
+    FILE* out   = (optind + 1 < argc) ? fopen(argv[optind + 1], "w") : stdout;
+
+    if (in == NULL || out == NULL || trace_load(in, &hdr, &recs) < 0)
+    {
+        fprintf(stderr, "%s: can not convert %s\n", argv[0], argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    // times are relative to the oldest record so they stay readable
+    uint64_t base = hdr.count ? recs[0].start : 0;
+
+    for (uint64_t indx = 0; indx < hdr.count; indx++)
+    {
+        if (recs[indx].start < base) base = recs[indx].start;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+
+    const char* sep = "";
+
+    for (uint64_t indx = 0; indx < hdr.count; indx++)
+    {
+        const trace_rec_t*  rec = &recs[indx];
+        double              dur = (rec->end - rec->start) / 1e3;
+
+        if (dur < min) continue;
+
+        if (rec->type == TRACE_WAIT)
+        {
+            fprintf(out, "%s{\"name\": \"wait\", \"cat\": \"wait\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                         "\"pid\": %u, \"tid\": %u, \"args\": {\"timeout_ms\": %d}}",
+                sep, (rec->start - base) / 1e3, dur, hdr.pid, rec->tid, (int) rec->flags);
+        }
+        else
+        {
+            char name[32];
+
+            // timers have no descriptor; the C++ loop gives them a negative id instead
+            if (rec->fd >= 0) snprintf(name, sizeof(name), "%s fd %d", trace_name(rec->type), rec->fd);
+            else snprintf(name, sizeof(name), "%s", trace_name(rec->type));
+
+            fprintf(out, "%s{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                         "\"pid\": %u, \"tid\": %u, \"args\": {\"fd\": %d, \"flags\": \"0x%x\", \"err\": %d}}",
+                sep, name, trace_name(rec->type), (rec->start - base) / 1e3, dur,
+                hdr.pid, rec->tid, rec->fd, rec->flags, rec->err);
+        }
+
+        sep = ",\n";
+    }
+
+    fprintf(out, "\n]}\n");
+
+    free(recs);
+    fclose(in);
+    if (out != stdout) fclose(out);
+
+    return EXIT_SUCCESS;
+}